@@ -41,6 +41,53 @@ public:
         std::vector<uint8_t> &templ,
         std::vector<EyePair> &eyeCoordinates) = 0;
 
+    /*!
+     * \brief Create templates for a batch of multiple face images at once.
+     *
+     * Implementations may override it to run the templates of a batch through the model together,
+     * the default implementation calls createTemplate for each element of the batch.
+     *
+     * \param faces The batch of multiple face images, one element per template.
+     * \param role The role of the templates to be created.
+     * \param templs The output vector that will store the created template data, one element per template.
+     * \param eyeCoordinates The output vector that will store the eye coordinates, one element per template.
+     * \param statuses The output vector that will store the status of each template creation.
+     *
+     * \return The return status of the batch as a whole, per template failures are reported in statuses.
+     */
+    virtual ReturnStatus
+    createTemplateBatch(
+        const std::vector<Multiface> &faces,
+        TemplateRole role,
+        std::vector<std::vector<uint8_t>> &templs,
+        std::vector<std::vector<EyePair>> &eyeCoordinates,
+        std::vector<ReturnStatus> &statuses)
+    {
+        templs.assign(faces.size(), std::vector<uint8_t>());
+        eyeCoordinates.assign(faces.size(), std::vector<EyePair>());
+        statuses.assign(faces.size(), ReturnStatus());
+
+        for (size_t i = 0; i < faces.size(); i++)
+            statuses[i] = createTemplate(faces[i], role, templs[i], eyeCoordinates[i]);
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
+    /*!
+     * \brief Get the requirements of the engine to the input images.
+     *
+     * \param requirements The output structure that will store the requirements, the default implementation sets no limits.
+     *
+     * \return The return status of the call.
+     */
+    virtual ReturnStatus
+    getImageRequirements(ImageRequirements &requirements)
+    {
+        requirements = ImageRequirements();
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /*!
      * \brief Finalize the initialization of the face recognition API.
      *
@@ -140,6 +140,118 @@ typedef struct EyePair
         {}
 } EyePair;
 
+/*!
+ * \brief The order of the color channels of 24-bit images.
+ */
+enum class ChannelOrder {
+    RGB,
+    BGR
+};
+
+/*!
+ * \brief The image size and layout the engine makes use of.
+ *
+ * The harness may deliver larger images downscaled, keeping both sides at least maxWidth x maxHeight.
+ * Zero means no limit. 24-bit images are delivered in channelOrder, so the engine does not have to
+ * reorder the channels itself.
+ */
+typedef struct ImageRequirements
+{
+    uint16_t maxWidth;
+    uint16_t maxHeight;
+    ChannelOrder channelOrder;
+
+    ImageRequirements() :
+        maxWidth{0},
+        maxHeight{0},
+        channelOrder{ChannelOrder::BGR}
+        {}
+
+    ImageRequirements(
+        uint16_t maxWidth,
+        uint16_t maxHeight,
+        ChannelOrder channelOrder = ChannelOrder::BGR
+        ) :
+        maxWidth{maxWidth},
+        maxHeight{maxHeight},
+        channelOrder{channelOrder}
+        {}
+} ImageRequirements;
+
+/*!
+ * \brief A read-only view of a template held by the harness, valid during the call it is passed to.
+ */
+typedef struct TemplateView
+{
+    const uint8_t *data;
+    size_t size;
+
+    TemplateView() :
+        data{nullptr},
+        size{0}
+        {}
+
+    TemplateView(
+        const uint8_t *data,
+        size_t size
+        ) :
+        data{data},
+        size{size}
+        {}
+} TemplateView;
+
+/*!
+ * \brief The type of the elements of a template that holds a plain vector.
+ */
+enum class TemplateElement {
+    Opaque,
+    Float32,
+    Float16,
+    Int8
+};
+
+/*!
+ * \brief The similarity of two template vectors: the dot product, the cosine of the angle or 1 / (1 + the Euclidean distance).
+ */
+enum class TemplateMetric {
+    Dot,
+    Cosine,
+    L2
+};
+
+/*!
+ * \brief The layout of a template that holds a plain vector, so the harness can match the templates itself.
+ *
+ * The vector is dimension elements of the native byte order starting offset bytes from the beginning of
+ * the template. An Opaque element means the templates are matched only by the engine.
+ */
+typedef struct TemplateLayout
+{
+    TemplateElement element;
+    TemplateMetric metric;
+    uint32_t offset;
+    uint32_t dimension;
+
+    TemplateLayout() :
+        element{TemplateElement::Opaque},
+        metric{TemplateMetric::Cosine},
+        offset{0},
+        dimension{0}
+        {}
+
+    TemplateLayout(
+        TemplateElement element,
+        TemplateMetric metric,
+        uint32_t offset,
+        uint32_t dimension
+        ) :
+        element{element},
+        metric{metric},
+        offset{offset},
+        dimension{dimension}
+        {}
+} TemplateLayout;
+
 class Interface {
 public:
     virtual ~Interface() {}
@@ -172,6 +284,56 @@ public:
         std::vector<EyePair> &eyeCoordinates,
         std::vector<double> &quality) = 0;
 
+    /*!
+     * \brief Create templates for a batch of multiple face images at once.
+     *
+     * Implementations may override it to run the templates of a batch through the model together,
+     * the default implementation calls createTemplate for each element of the batch.
+     *
+     * \param faces The batch of multiple face images, one element per template.
+     * \param role The role of the templates to be created.
+     * \param templs The output vector that will store the created template data, one element per template.
+     * \param eyeCoordinates The output vector that will store the eye coordinates, one element per template.
+     * \param quality The output vector that will store the quality values, one element per template.
+     * \param statuses The output vector that will store the status of each template creation.
+     *
+     * \return The return status of the batch as a whole, per template failures are reported in statuses.
+     */
+    virtual ReturnStatus
+    createTemplateBatch(
+        const std::vector<Multiface> &faces,
+        TemplateRole role,
+        std::vector<std::vector<uint8_t>> &templs,
+        std::vector<std::vector<EyePair>> &eyeCoordinates,
+        std::vector<std::vector<double>> &quality,
+        std::vector<ReturnStatus> &statuses)
+    {
+        templs.assign(faces.size(), std::vector<uint8_t>());
+        eyeCoordinates.assign(faces.size(), std::vector<EyePair>());
+        quality.assign(faces.size(), std::vector<double>());
+        statuses.assign(faces.size(), ReturnStatus());
+
+        for (size_t i = 0; i < faces.size(); i++)
+            statuses[i] = createTemplate(faces[i], role, templs[i], eyeCoordinates[i], quality[i]);
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
+    /*!
+     * \brief Get the requirements of the engine to the input images.
+     *
+     * \param requirements The output structure that will store the requirements, the default implementation sets no limits.
+     *
+     * \return The return status of the call.
+     */
+    virtual ReturnStatus
+    getImageRequirements(ImageRequirements &requirements)
+    {
+        requirements = ImageRequirements();
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /*!
      * \brief Create a face template from the input face images.
      *
@@ -189,6 +351,58 @@ public:
         const std::vector<uint8_t> &initTemplate,
         double &similarity) = 0;
 
+    /*!
+     * \brief Match one template against several templates at once.
+     *
+     * Implementations may override it to compare the verification template with all templates together,
+     * the default implementation calls matchTemplates for each of them.
+     *
+     * \param verifTemplate The verification template.
+     * \param initTemplates The templates to compare the verification template with.
+     * \param similarities The output vector that will store the similarity to each of initTemplates.
+     *
+     * \return The return status of the batch, a failure of any comparison fails the batch.
+     */
+    virtual ReturnStatus
+    matchTemplatesBatch(
+        const std::vector<uint8_t> &verifTemplate,
+        const std::vector<TemplateView> &initTemplates,
+        std::vector<double> &similarities)
+    {
+        similarities.assign(initTemplates.size(), 0);
+
+        std::vector<uint8_t> initTemplate;
+        for (size_t i = 0; i < initTemplates.size(); i++)
+        {
+            initTemplate.assign(initTemplates[i].data, initTemplates[i].data + initTemplates[i].size);
+
+            ReturnStatus status = matchTemplates(verifTemplate, initTemplate, similarities[i]);
+            if (status.code != ReturnCode::Success)
+                return status;
+        }
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
+    /*!
+     * \brief Get the layout of the templates created by the engine.
+     *
+     * Engines whose templates hold a plain vector may declare it, the harness can then match the templates
+     * with its own vectorized matcher instead of matchTemplatesBatch when it is asked to. The default
+     * implementation declares opaque templates.
+     *
+     * \param layout The output structure that will store the layout.
+     *
+     * \return The return status of the call.
+     */
+    virtual ReturnStatus
+    getTemplateLayout(TemplateLayout &layout)
+    {
+        layout = TemplateLayout();
+
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /*!
      * \brief Fine-tuning the face recognition model using the provided configuration and save the trained model to the specified directory.
      *
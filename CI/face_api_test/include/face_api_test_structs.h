@@ -155,6 +155,44 @@ typedef struct EyePair
         {}
 } EyePair;
 
+/*!
+ * \brief The order of the color channels of 24-bit images.
+ */
+enum class ChannelOrder {
+    RGB,
+    BGR
+};
+
+/*!
+ * \brief The image size and layout the engine makes use of.
+ *
+ * The harness may deliver larger images downscaled, keeping both sides at least maxWidth x maxHeight.
+ * Zero means no limit. 24-bit images are delivered in channelOrder, so the engine does not have to
+ * reorder the channels itself.
+ */
+typedef struct ImageRequirements
+{
+    uint16_t maxWidth;
+    uint16_t maxHeight;
+    ChannelOrder channelOrder;
+
+    ImageRequirements() :
+        maxWidth{0},
+        maxHeight{0},
+        channelOrder{ChannelOrder::BGR}
+        {}
+
+    ImageRequirements(
+        uint16_t maxWidth,
+        uint16_t maxHeight,
+        ChannelOrder channelOrder = ChannelOrder::BGR
+        ) :
+        maxWidth{maxWidth},
+        maxHeight{maxHeight},
+        channelOrder{channelOrder}
+        {}
+} ImageRequirements;
+
 typedef struct Candidate {
     bool isAssigned;
 
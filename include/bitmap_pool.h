@@ -0,0 +1,56 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ * \brief Pool of reusable bitmap buffers of one extract worker.
+ *
+ * get() hands out a buffer wrapped into a shared_ptr, the buffer returns to the pool when the last
+ * reference is dropped, so decoded images do not allocate a new raster each time. The pool state is
+ * shared with the handed out buffers, they stay valid even if the pool is destroyed first.
+ */
+class bitmap_pool
+{
+
+public:
+    /*!
+     * \brief Create an empty pool.
+     *
+     * \param max_free_buffers The count of returned buffers the pool keeps for reuse.
+     */
+    bitmap_pool(size_t max_free_buffers);
+
+    bitmap_pool(const bitmap_pool&) = delete;
+    bitmap_pool& operator=(const bitmap_pool&) = delete;
+
+    /*!
+     * \brief Take a buffer of at least the given size.
+     *
+     * \param size The size of the buffer in bytes.
+     *
+     * \return A shared_ptr to the buffer, it returns to the pool on release.
+     */
+    shared_ptr<uint8_t> get(size_t size);
+
+private:
+    struct buffer_type
+    {
+        size_t capacity;
+        unique_ptr<uint8_t[]> data;
+    };
+
+    struct pool_state
+    {
+        mutex pool_mutex;
+        vector<buffer_type> free_buffers;
+        size_t max_free_buffers;
+    };
+
+    shared_ptr<pool_state> m_state;
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "utils.h"
+#include "in_out.h"
+#include "extract_scheduler.h"
+#include "image_cache.h"
+#include "image_pack.h"
+#include "extract_progress.h"
+
+using namespace std;
+
+template<typename T_Multiface>
+/*!
+ * \brief Decode stage of one extract worker.
+ *
+ * Decode threads take chunks of templates from the scheduler, decode their images and put them
+ * into a bounded queue. The extract worker pops the decoded templates as soon as they are ready,
+ * so decoding of the next templates overlaps with createTemplate and one large image does not
+ * block the templates decoded after it. At most queue_depth templates are decoded ahead.
+ * Without decode threads the images are decoded by the extract worker itself on pop().
+ * With an image cache the bitmaps are taken from the cache instead of decoding on a hit.
+ */
+class decode_pipeline
+{
+
+public:
+    /*!
+     * \brief Create the decode stage and start the decode threads.
+     *
+     * \param scheduler The scheduler handing out chunks of templates.
+     * \param input_list A shared_ptr to input_list_type containing the templates.
+     * \param extract_prefix The images directory with a trailing slash.
+     * \param layout The pixel layout of the bitmaps: RGB, BGR or grayscale.
+     * \param max_width The width the engine makes use of, larger JPEG images are decoded at a reduced scale (0 - no limit).
+     * \param max_height The height the engine makes use of, larger JPEG images are decoded at a reduced scale (0 - no limit).
+     * \param decode_threads The count of decode threads (0 - decode in the extract worker).
+     * \param queue_depth The count of decoded templates the ring can hold.
+     * \param cache The decoded image cache, nullptr to decode every image.
+     * \param pool The pool of bitmap buffers, nullptr to allocate every bitmap.
+     * \param progress The progress to add the decoded images and stage times to, nullptr to skip it.
+     * \param pack The pack of pre-decoded images to take the bitmaps from instead of the image files, nullptr to decode the files.
+     */
+    decode_pipeline(extract_scheduler& scheduler, shared_ptr<const input_list_type> input_list, const string& extract_prefix, bitmap_layout layout, size_t max_width, size_t max_height, uint decode_threads, uint queue_depth, image_cache* cache = nullptr, bitmap_pool* pool = nullptr, extract_progress* progress = nullptr, const image_pack* pack = nullptr);
+    ~decode_pipeline();
+
+    decode_pipeline(const decode_pipeline&) = delete;
+    decode_pipeline& operator=(const decode_pipeline&) = delete;
+
+    /*!
+     * \brief Take the next decoded template.
+     *
+     * \param templ_index Output parameter to store the template index in the input list.
+     * \param images Output parameter to store the decoded template images.
+     *
+     * \return 'true' if a template was taken, 'false' if all templates are already handed out.
+     *
+     * \throws The error of the decode of this template, if any.
+     */
+    bool pop(size_t& templ_index, T_Multiface& images);
+
+    /*!
+     * \brief Log the queue depth and stall times of the decode stage.
+     *
+     * \param fork_index The index of the extract worker.
+     */
+    void log_stats(size_t fork_index) const;
+
+private:
+    struct slot_type
+    {
+        size_t templ_index;
+        T_Multiface images;
+        exception_ptr error;
+    };
+
+    bool take_template(size_t& templ_index);
+    void decode(size_t templ_index, T_Multiface& images) const;
+    void decode_loop();
+
+    extract_scheduler& m_scheduler;
+    shared_ptr<const input_list_type> m_input_list;
+    string m_extract_prefix;
+    bitmap_layout m_layout;
+    size_t m_max_width;
+    size_t m_max_height;
+    image_cache* m_cache;
+    bitmap_pool* m_pool;
+    extract_progress* m_progress;
+    const image_pack* m_pack;
+
+    size_t m_chunk_next = 0;
+    size_t m_chunk_end = 0;
+    bool m_exhausted = false;
+
+    size_t m_queue_depth = 0;
+    deque<slot_type> m_ready;
+    vector<thread> m_threads;
+    mutable mutex m_mutex;
+    condition_variable m_ready_cv;
+    condition_variable m_free_cv;
+    size_t m_in_flight = 0;
+    bool m_stop = false;
+
+    size_t m_pop_count = 0;
+    size_t m_depth_acc = 0;
+    nanoseconds m_consumer_stall{0};
+    nanoseconds m_decoder_stall{0};
+};
+
+
+//-----------------------------------------------------------------------Template Implementation-----------------------------------------------------------------------------------
+
+
+template<typename T_Multiface>
+/*!
+ * \brief Create the decode stage and start the decode threads.
+ *
+ * \param scheduler The scheduler handing out chunks of templates.
+ * \param input_list A shared_ptr to input_list_type containing the templates.
+ * \param extract_prefix The images directory with a trailing slash.
+ * \param layout The pixel layout of the bitmaps: RGB, BGR or grayscale.
+ * \param max_width The width the engine makes use of, larger JPEG images are decoded at a reduced scale (0 - no limit).
+ * \param max_height The height the engine makes use of, larger JPEG images are decoded at a reduced scale (0 - no limit).
+ * \param decode_threads The count of decode threads (0 - decode in the extract worker).
+ * \param queue_depth The count of decoded templates the ring can hold.
+ * \param cache The decoded image cache, nullptr to decode every image.
+ * \param pool The pool of bitmap buffers, nullptr to allocate every bitmap.
+ * \param progress The progress to add the decoded images and stage times to, nullptr to skip it.
+ * \param pack The pack of pre-decoded images to take the bitmaps from instead of the image files, nullptr to decode the files.
+ */
+decode_pipeline<T_Multiface>::decode_pipeline(extract_scheduler& scheduler, shared_ptr<const input_list_type> input_list, const string& extract_prefix, bitmap_layout layout, size_t max_width, size_t max_height, uint decode_threads, uint queue_depth, image_cache* cache, bitmap_pool* pool, extract_progress* progress, const image_pack* pack)
+    : m_scheduler(scheduler), m_input_list(input_list), m_extract_prefix(extract_prefix), m_layout(layout), m_max_width(max_width), m_max_height(max_height), m_cache(cache), m_pool(pool), m_progress(progress), m_pack(pack)
+{
+    if(!decode_threads)
+        return;
+
+    if(!queue_depth)
+        throw logic_error("decode queue depth must be greater than 0");
+
+    m_queue_depth = queue_depth;
+
+    for(uint i = 0; i < decode_threads; i++)
+        m_threads.emplace_back(&decode_pipeline::decode_loop, this);
+}
+
+template<typename T_Multiface>
+decode_pipeline<T_Multiface>::~decode_pipeline()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_free_cv.notify_all();
+
+    for(auto& decode_thread : m_threads)
+        decode_thread.join();
+}
+
+template<typename T_Multiface>
+/*!
+ * \brief Take the next template index from the current chunk or from the scheduler.
+ *
+ * \param templ_index Output parameter to store the template index.
+ *
+ * \return 'true' if a template was taken, 'false' if the scheduler is exhausted.
+ */
+bool decode_pipeline<T_Multiface>::take_template(size_t& templ_index)
+{
+    if(m_chunk_next == m_chunk_end)
+    {
+        if(m_exhausted || !m_scheduler.next(m_chunk_next, m_chunk_end))
+        {
+            m_exhausted = true;
+            return false;
+        }
+    }
+
+    templ_index = m_scheduler.templ_index(m_chunk_next++);
+    return true;
+}
+
+template<typename T_Multiface>
+/*!
+ * \brief Decode all images of a template.
+ *
+ * \param templ_index The template index in the input list.
+ * \param images Output parameter to store the decoded images.
+ */
+void decode_pipeline<T_Multiface>::decode(size_t templ_index, T_Multiface& images) const
+{
+    images.clear();
+
+    bitmap_timings timings;
+    bitmap_timings* timings_ptr = m_progress ? &timings : nullptr;
+
+    for(const string& path : (*m_input_list)[templ_index].first)
+    {
+        size_t bitmap_W = 0, bitmap_H = 0;
+        shared_ptr<uint8_t> bitmap;
+
+        if(m_pack)
+            bitmap = m_pack->get_bitmap(path, bitmap_W, bitmap_H);
+        else if(m_cache)
+            bitmap = m_cache->get_bitmap(m_extract_prefix + path, m_layout, bitmap_W, bitmap_H, m_max_width, m_max_height, m_pool, timings_ptr);
+        else
+            bitmap = get_bitmap(m_extract_prefix + path, m_layout, bitmap_W, bitmap_H, m_max_width, m_max_height, m_pool, timings_ptr);
+
+        images.emplace_back(static_cast<uint16_t>(bitmap_W), static_cast<uint16_t>(bitmap_H), static_cast<uint8_t>(8 * bitmap_layout_channels(m_layout)), bitmap);
+    }
+
+    if(m_progress)
+        m_progress->add_images(timings, images.size());
+}
+
+template<typename T_Multiface>
+/*!
+ * \brief Decode thread body: take the next template, decode it and publish it to the queue.
+ */
+void decode_pipeline<T_Multiface>::decode_loop()
+{
+    while(true)
+    {
+        size_t templ_index = 0;
+        {
+            unique_lock<mutex> lock(m_mutex);
+
+            if(!m_stop && m_in_flight >= m_queue_depth)
+            {
+                const auto tstart = high_resolution_clock::now();
+                m_free_cv.wait(lock, [&]() { return m_stop || m_in_flight < m_queue_depth; });
+                m_decoder_stall += high_resolution_clock::now() - tstart;
+            }
+
+            if(m_stop)
+                return;
+
+            if(!take_template(templ_index))
+            {
+                m_ready_cv.notify_all();
+                return;
+            }
+
+            m_in_flight++;
+        }
+
+        T_Multiface images;
+        exception_ptr error;
+        try
+        {
+            decode(templ_index, images);
+        }
+        catch(...)
+        {
+            error = current_exception();
+        }
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_ready.push_back({templ_index, move(images), error});
+        }
+        m_ready_cv.notify_one();
+    }
+}
+
+template<typename T_Multiface>
+/*!
+ * \brief Take the next decoded template.
+ *
+ * \param templ_index Output parameter to store the template index in the input list.
+ * \param images Output parameter to store the decoded template images.
+ *
+ * \return 'true' if a template was taken, 'false' if all templates are already handed out.
+ *
+ * \throws The error of the decode of this template, if any.
+ */
+bool decode_pipeline<T_Multiface>::pop(size_t& templ_index, T_Multiface& images)
+{
+    if(m_threads.empty())
+    {
+        if(!take_template(templ_index))
+            return false;
+
+        decode(templ_index, images);
+        return true;
+    }
+
+    exception_ptr error;
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        auto ready_pred = [&]() { return !m_ready.empty() || (m_exhausted && !m_in_flight); };
+
+        if(!ready_pred())
+        {
+            const auto tstart = high_resolution_clock::now();
+            m_ready_cv.wait(lock, ready_pred);
+            m_consumer_stall += high_resolution_clock::now() - tstart;
+        }
+
+        if(m_ready.empty())
+            return false;
+
+        m_pop_count++;
+        m_depth_acc += m_ready.size();
+
+        slot_type& slot = m_ready.front();
+        templ_index = slot.templ_index;
+        images = move(slot.images);
+        error = slot.error;
+        m_ready.pop_front();
+
+        m_in_flight--;
+    }
+    m_free_cv.notify_one();
+
+    if(error)
+        rethrow_exception(error);
+
+    return true;
+}
+
+template<typename T_Multiface>
+/*!
+ * \brief Log the queue depth and stall times of the decode stage.
+ *
+ * \param fork_index The index of the extract worker.
+ */
+void decode_pipeline<T_Multiface>::log_stats(size_t fork_index) const
+{
+    if(m_threads.empty())
+        return;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    const double average_depth = m_pop_count ? static_cast<double>(m_depth_acc) / m_pop_count : 0;
+
+    LOG(INFO) << "proc " << fork_index << " - decode queue: average depth " << to_string_form(average_depth, 2) << " of " << m_queue_depth
+              << ", createTemplate stall - " << duration_to_string(duration<double, milli>(m_consumer_stall), 2)
+              << ", decode stall - " << duration_to_string(duration<double, milli>(m_decoder_stall), 2);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "desc_set.h"
+
+using namespace std;
+
+/*!
+ * \brief Container of the descriptors of an extract list, mapped into memory by the match and search stages.
+ *
+ * The file holds a header (magic, version, maximum descriptor size, count, refusal count, checksum), the labels
+ * of all templates as an int array, an offset table and the descriptors as one block aligned to 64 bytes, in the
+ * order of the extract list. Refused templates have a negative label and an empty descriptor.
+ *
+ * During extraction every template has a slot of the maximum descriptor size in the block and its entry in
+ * the offset table holds the size of its descriptor, so the workers write labels, sizes and descriptors
+ * straight to their offsets. Once all workers are done finalize() packs the descriptors, turns the sizes
+ * into offsets and truncates the file, so each template takes exactly its own size.
+ */
+class desc_file
+{
+
+public:
+    /*!
+     * \brief Map a finalized descriptor file and check its header and offset table.
+     *
+     * \param file The file path of the descriptors.
+     * \param verify_flag Flag to indicate whether to check the labels, offsets and descriptors against the checksum.
+     */
+    desc_file(const string& file, bool verify_flag = true);
+
+    desc_file(const desc_file&) = delete;
+    desc_file& operator=(const desc_file&) = delete;
+
+    /*!
+     * \brief Get the count of descriptors.
+     *
+     * \return The count of descriptors, refusals included.
+     */
+    size_t size() const;
+
+    /*!
+     * \brief Get the maximum size of one descriptor.
+     *
+     * \return The maximum descriptor size in bytes the file was extracted with.
+     */
+    size_t desc_size() const;
+
+    /*!
+     * \brief Get the size of all descriptors.
+     *
+     * \return The size of the descriptor block in bytes.
+     */
+    size_t descriptors_size() const;
+
+    /*!
+     * \brief Get the count of refused templates.
+     *
+     * \return The count of descriptors with a negative label.
+     */
+    size_t refusal_count() const;
+
+    /*!
+     * \brief Get the labels and descriptors as a descriptor set.
+     *
+     * \return A read-only desc_set viewing the mapping, which it keeps alive.
+     */
+    desc_set descriptors() const;
+
+    /*!
+     * \brief Create a descriptor file with its final size and header, so extract workers can write to their offsets without locking.
+     *
+     * \param file The file path of the descriptors.
+     * \param count The count of templates in the extract list.
+     * \param desc_size The maximum descriptor size.
+     */
+    static void create(const string& file, size_t count, uint desc_size);
+
+    /*!
+     * \brief Check that an existing descriptor file was created for the same count and maximum descriptor size.
+     *
+     * \param file The file path of the descriptors.
+     * \param count The count of templates in the extract list.
+     * \param desc_size The maximum descriptor size.
+     *
+     * \return 'true' if the file is already finalized, no more templates can be written to it.
+     */
+    static bool check(const string& file, size_t count, uint desc_size);
+
+    /*!
+     * \brief Pack the descriptors of a written descriptor file, count the refusals, compute the checksum and store them in its header.
+     *
+     * \param file The file path of the descriptors.
+     * \param labels Pointer to a vector to store a copy of the labels while they are at hand, nullptr for none.
+     * \param offsets Pointer to a vector to store the offsets of the descriptors from the beginning of the file, count + 1 elements, nullptr for none.
+     */
+    static void finalize(const string& file, vector<int>* labels = nullptr, vector<uint64_t>* offsets = nullptr);
+
+    /*!
+     * \brief Get the offset of a label in a descriptor file.
+     *
+     * \param index The index of the template.
+     *
+     * \return The offset in bytes from the beginning of the file.
+     */
+    static size_t label_offset(size_t index);
+
+    /*!
+     * \brief Get the offset of an entry of the offset table in a descriptor file.
+     *
+     * \param count The count of templates in the file.
+     * \param index The index of the template.
+     *
+     * \return The offset in bytes from the beginning of the file.
+     */
+    static size_t table_offset(size_t count, size_t index);
+
+    /*!
+     * \brief Get the offset of the slot of a descriptor in a descriptor file that is not finalized yet.
+     *
+     * \param count The count of templates in the file.
+     * \param desc_size The maximum descriptor size.
+     * \param index The index of the template.
+     *
+     * \return The offset in bytes from the beginning of the file.
+     */
+    static size_t descriptor_offset(size_t count, size_t desc_size, size_t index);
+
+private:
+    enum file_state : uint64_t
+    {
+        state_slots = 0,
+        state_packing = 1,
+        state_packed = 2
+    };
+
+    struct file_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t desc_size;
+        uint64_t count;
+        uint64_t refusal_count;
+        uint64_t descriptors_offset;
+        uint64_t descriptors_size;
+        uint64_t state;
+        uint64_t checksum;
+    };
+
+    static file_header make_header(size_t count, uint desc_size);
+    static void check_header(const file_header& header, size_t file_size, const string& file);
+    static uint64_t checksum(const uint8_t* base, const file_header& header);
+
+    shared_ptr<uint8_t> m_mapping;
+    file_header m_header;
+};
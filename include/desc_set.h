@@ -0,0 +1,143 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ * \brief Set of descriptors of varying size stored as a matrix: one 64-byte aligned buffer of rows and an array of labels.
+ *
+ * A set either owns its buffers and grows by push_back(), as the extract output does, or is a read-only view
+ * of buffers owned elsewhere, as a mapped descriptor file, kept alive by a shared_ptr. An owned set stores each
+ * row in a slot of slot_size() bytes, the layout of the descriptor file during extraction. A view locates its
+ * rows through an offset table, the rows follow each other without padding.
+ */
+class desc_set
+{
+
+public:
+    /*!
+     * \brief Create an empty set that owns its buffers.
+     *
+     * \param slot_size The maximum descriptor size.
+     */
+    explicit desc_set(size_t slot_size = 0);
+
+    /*!
+     * \brief Create a read-only view of labels and descriptors owned elsewhere.
+     *
+     * \param count The count of descriptors.
+     * \param labels The labels, count elements.
+     * \param offsets The offsets of the descriptors from data, count + 1 elements, the last one is the end of the last descriptor.
+     * \param data The descriptors.
+     * \param owner The object owning the labels, the offsets and the descriptors, kept alive while the view exists.
+     */
+    desc_set(size_t count, const int* labels, const uint64_t* offsets, const uint8_t* data, shared_ptr<const void> owner);
+
+    desc_set(desc_set&&) = default;
+    desc_set& operator=(desc_set&&) = default;
+
+    desc_set(const desc_set&) = delete;
+    desc_set& operator=(const desc_set&) = delete;
+
+    /*!
+     * \brief Get the count of descriptors.
+     *
+     * \return The count of descriptors.
+     */
+    size_t size() const { return m_count; }
+
+    /*!
+     * \brief Check whether the set has no descriptors.
+     *
+     * \return 'true' if the set is empty.
+     */
+    bool empty() const { return !m_count; }
+
+    /*!
+     * \brief Get the label of a descriptor.
+     *
+     * \param index The index of the descriptor.
+     *
+     * \return The label, negative for a refused template.
+     */
+    int label(size_t index) const { return m_labels[index]; }
+
+    /*!
+     * \brief Get a descriptor.
+     *
+     * \param index The index of the descriptor.
+     *
+     * \return A pointer to row_size(index) bytes of the descriptor.
+     */
+    const uint8_t* row(size_t index) const { return m_owner ? m_data + m_offsets[index] : m_data + index * m_slot_size; }
+
+    /*!
+     * \brief Get the size of a descriptor.
+     *
+     * \param index The index of the descriptor.
+     *
+     * \return The descriptor size in bytes, 0 for a refused template.
+     */
+    size_t row_size(size_t index) const { return m_owner ? m_offsets[index + 1] - m_offsets[index] : m_own_sizes[index]; }
+
+    /*!
+     * \brief Get the labels of all descriptors.
+     *
+     * \return A pointer to size() labels.
+     */
+    const int* labels() const { return m_labels; }
+
+    /*!
+     * \brief Get the slot size of a set that owns its buffers.
+     *
+     * \return The maximum descriptor size, each row takes a slot of this size.
+     */
+    size_t slot_size() const { return m_slot_size; }
+
+    /*!
+     * \brief Get the descriptor sizes of a set that owns its buffers.
+     *
+     * \return A pointer to size() descriptor sizes.
+     */
+    const uint64_t* sizes() const { return m_own_sizes.data(); }
+
+    /*!
+     * \brief Get the slots of a set that owns its buffers.
+     *
+     * \return A pointer to size() slots of slot_size() bytes, aligned to 64 bytes, the bytes past a descriptor are zero.
+     */
+    const uint8_t* slots() const { return m_data; }
+
+    /*!
+     * \brief Append a descriptor to a set that owns its buffers.
+     *
+     * \param label The label of the descriptor.
+     * \param descriptor The descriptor.
+     * \param size The descriptor size, at most slot_size().
+     */
+    void push_back(int label, const uint8_t* descriptor, size_t size);
+
+    /*!
+     * \brief Remove all descriptors of a set that owns its buffers, the capacity is kept.
+     */
+    void clear();
+
+private:
+    void reserve(size_t capacity);
+
+    size_t m_slot_size;
+    size_t m_count;
+    size_t m_capacity;
+    const int* m_labels;
+    const uint64_t* m_offsets;
+    const uint8_t* m_data;
+
+    vector<int> m_own_labels;
+    vector<uint64_t> m_own_sizes;
+    shared_ptr<uint8_t> m_own_data;
+    shared_ptr<const void> m_owner;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "utils.h"
+
+using namespace std;
+
+/*!
+ * \brief Stages of the extract pipeline measured by extract_progress.
+ */
+enum class extract_stage
+{
+    read,
+    decode,
+    convert,
+    create_template,
+    write,
+    count
+};
+
+/*!
+ * \brief Progress of the extract stage aggregated over all extract workers.
+ *
+ * The counters live in anonymous shared memory, so one object created before fork() is updated by
+ * all child processes as well as by threads of one process. Any worker may print the periodic report,
+ * the first one to see it is due takes it, so no reporter thread is needed.
+ */
+class extract_progress
+{
+
+public:
+    /*!
+     * \brief Create the shared counters.
+     *
+     * \param count_templates The count of templates the extract stage has to process.
+     * \param report_interval The interval of the periodic reports (0 - no periodic reports).
+     */
+    extract_progress(size_t count_templates, seconds report_interval);
+    ~extract_progress();
+
+    extract_progress(const extract_progress&) = delete;
+    extract_progress& operator=(const extract_progress&) = delete;
+
+    /*!
+     * \brief Add time spent in a stage.
+     *
+     * \param stage The stage.
+     * \param interval The time spent.
+     */
+    void add_time(extract_stage stage, nanoseconds interval);
+
+    /*!
+     * \brief Add the timings of loaded images.
+     *
+     * \param timings The time spent in the read, decode and convert stages.
+     * \param count_images The count of loaded images.
+     */
+    void add_images(const bitmap_timings& timings, size_t count_images);
+
+    /*!
+     * \brief Count processed templates and print the periodic report if it is due.
+     *
+     * \param count_templates The count of templates processed since the last call.
+     */
+    void add_templates(size_t count_templates);
+
+    /*!
+     * \brief Log the summary of the extract stage.
+     */
+    void log_summary() const;
+
+private:
+    struct shared_counters
+    {
+        atomic<uint64_t> templates;
+        atomic<uint64_t> images;
+        atomic<uint64_t> stage_ns[static_cast<size_t>(extract_stage::count)];
+        atomic<int64_t> last_report_ns;
+    };
+
+    void log_stage_split() const;
+    int64_t elapsed_ns() const;
+
+    shared_counters* m_counters;
+    size_t m_count_templates;
+    int64_t m_report_interval_ns;
+    steady_clock::time_point m_tstart;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ * \brief Dynamic scheduler handing out small chunks of templates to extract workers at run time.
+ *
+ * The cursor lives in anonymous shared memory, so one scheduler created before fork() is shared
+ * by all child processes as well as by threads of one process. Chunks are ranges of positions in
+ * the dispatch order, templ_index() maps a position to the template index in the input list.
+ */
+class extract_scheduler
+{
+
+public:
+    /*!
+     * \brief Create a scheduler over templates [0, count).
+     *
+     * \param count The count of templates to hand out.
+     * \param chunk_size The count of templates handed out by one next() call.
+     */
+    extract_scheduler(size_t count, size_t chunk_size);
+
+    /*!
+     * \brief Create a scheduler over the given templates in the given dispatch order.
+     *
+     * \param order The template indices to hand out, in dispatch order.
+     * \param chunk_size The count of templates handed out by one next() call.
+     */
+    extract_scheduler(vector<size_t> order, size_t chunk_size);
+    ~extract_scheduler();
+
+    extract_scheduler(const extract_scheduler&) = delete;
+    extract_scheduler& operator=(const extract_scheduler&) = delete;
+
+    /*!
+     * \brief Take the next chunk of templates.
+     *
+     * \param begin Output parameter to store the first dispatch position of the chunk.
+     * \param end Output parameter to store the position past the last template of the chunk.
+     *
+     * \return 'true' if a chunk was taken, 'false' if all templates are already handed out.
+     */
+    bool next(size_t& begin, size_t& end);
+
+    /*!
+     * \brief Get the template index in the input list for a dispatch position.
+     *
+     * \param pos The dispatch position taken with next().
+     *
+     * \return The template index.
+     */
+    size_t templ_index(size_t pos) const
+    {
+        return m_order.empty() ? pos : m_order[pos];
+    }
+
+private:
+    void map_cursor();
+
+    atomic<size_t>* m_cursor;
+    vector<size_t> m_order;
+    size_t m_count;
+    size_t m_chunk_size;
+};
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <thread>
+
 #include <FreeImage.h>
 
 #include "utils.h"
 #include "in_out.h"
+#include "extract_scheduler.h"
+#include "decode_pipeline.h"
+#include "image_cache.h"
+#include "worker_placement.h"
+#include "extract_progress.h"
 
 using namespace std;
 
@@ -17,16 +24,20 @@ template<typename T_ReturnCode>
  */
 string errcode_to_string(const T_ReturnCode& code);
 
-template<typename T_FACEAPI, bool create_manifest_flag>
+template<typename T_FACEAPI>
 /*!
  * \brief Extracts face templates from input images and creates descriptors.
  *
+ * All lists are extracted in one pass of the workers, a template with the same images in several lists is extracted
+ * once and written to each of them.
+ *
  * \param face_api_ptr A shared pointer to a typename T_FACEAPI::face_api_type object representing the face API.
  * \param params A reference to a params_type object containing input parameters.
  * \param output_dir The directory where the output files will be written.
- * \param list_name The name of the list file containing image paths.
+ * \param list_names The names of the list files containing image paths.
+ * \param manifest_list_name The name of the list to write the manifest for, empty for no manifest.
  */
-void FACEAPI_extract_template(shared_ptr<typename T_FACEAPI::face_api_type> face_api_ptr, params_type& params, const string& output_dir, const string& list_name);
+void FACEAPI_extract_template(shared_ptr<typename T_FACEAPI::face_api_type> face_api_ptr, params_type& params, const string& output_dir, const vector<string>& list_names, const string& manifest_list_name = "");
 
 
 //-----------------------------------------------------------------------Template Implementation-----------------------------------------------------------------------------------
@@ -47,141 +58,528 @@ string errcode_to_string(const T_ReturnCode& code)
     return string_stream.str();
 }
 
-template<typename T_FACEAPI, bool create_manifest_flag>
+template<typename T_FACEAPI>
 /*!
  * \brief Extracts face templates from input images and creates descriptors.
  *
+ * All lists are extracted in one pass of the workers, a template with the same images in several lists is extracted
+ * once and written to each of them.
+ *
  * \param face_api_ptr A shared pointer to a typename T_FACEAPI::face_api_type object representing the face API.
  * \param params A reference to a params_type object containing input parameters.
  * \param output_dir The directory where the output files will be written.
- * \param list_name The name of the list file containing image paths.
+ * \param list_names The names of the list files containing image paths.
+ * \param manifest_list_name The name of the list to write the manifest for, empty for no manifest.
  */
-void FACEAPI_extract_template(shared_ptr<typename T_FACEAPI::face_api_type> face_api_ptr, params_type& params, const string& output_dir, const string& list_name)
+void FACEAPI_extract_template(shared_ptr<typename T_FACEAPI::face_api_type> face_api_ptr, params_type& params, const string& output_dir, const vector<string>& list_names, const string& manifest_list_name)
 {
-    const string list_file = get_abs(params[list_name], params);
-    const string file_long_prefix =  output_dir + "/" + get_filename(list_file);
-
-    LOG(INFO) << "createTemplate start for " + list_file + "...";
+    struct extract_list
+    {
+        string file_long_prefix;
+        shared_ptr<input_list_type> input_list;
+        vector<string> text_files;
+        string journal_file;
+        vector<string> journal_text_files;
+    };
+
+    const bool extract_info_flag = get_param<bool>(params["extract_info"]);
+    const bool debug_info_flag = get_param<bool>(params["debug_info"]);
+    const bool extra_timings_flag = get_param<bool>(params["extra_timings"]);
+    const float percentile = get_param<uint>(params["percentile"]) / 100.f;
 
+    uint count_proc = get_param<uint>(params["count_proc"]);
+    uint desc_size = get_param<uint>(params["desc_size"]);
+    uint chunk_size = get_param<uint>(params["extract_chunk"]);
+    uint decode_threads = get_param<uint>(params["decode_threads"]);
+    uint decode_queue = get_param<uint>(params["decode_queue"]);
+    uint write_batch = get_param<uint>(params["write_batch"]);
+    uint extract_batch = get_param<uint>(params["extract_batch"]);
+    bool threads_flag = extract_mode_is_threads(get_param<string>(params["extract_mode"]));
+    bool resume_flag = get_param<bool>(params["resume"]);
+    bool image_cache_flag = get_param<bool>(params["image_cache"]);
+    bool reduced_decode_flag = get_param<bool>(params["reduced_decode"]);
+    bool bind_memory_flag = get_param<bool>(params["bind_memory"]);
+    const vector<worker_placement> placements = plan_worker_placement(get_param<string>(params["pin_cpus"]), count_proc);
+    const string sweep_mode = get_param<string>(params["scaling_sweep"]);
+    uint sweep_sample = get_param<uint>(params["scaling_sweep_sample"]);
+    bool cost_order_flag = get_param<bool>(params["cost_order"]);
+
+    if(sweep_mode != "none" && sweep_mode != "report" && sweep_mode != "apply")
+        throw logic_error("unknown scaling_sweep: " + sweep_mode + ", expected none, report or apply");
+
+    if(list_names.empty())
+        return;
+
+    vector<extract_list> lists;
+    vector<shared_ptr<input_list_type>> input_lists;
+    vector<vector<size_t>> pending;
+
+    for(const string& list_name : list_names)
     {
-        unique_ptr<ofstream> desc_stream = open_file_or_die<ofstream>(file_long_prefix + ".bin");
+        const string list_file = get_abs(params[list_name], params);
+
+        LOG(INFO) << "createTemplate start for " + list_file + "...";
+
+        extract_list list;
+        list.file_long_prefix = output_dir + "/" + get_filename(list_file);
+        list.input_list = read_input_extract(list_file);
+
+        list.text_files = {list.file_long_prefix + "_fail.txt"};
+        if(extract_info_flag)
+            list.text_files.push_back(list.file_long_prefix + "_info.txt");
+        if(debug_info_flag)
+            list.text_files.push_back(list.file_long_prefix + "_debug_info.txt");
+
+        list.journal_file = list.file_long_prefix + "_journal.txt";
+        list.journal_text_files = {list.file_long_prefix + "_fail.txt", list.file_long_prefix + "_info.txt", list.file_long_prefix + "_debug_info.txt"};
+
+        vector<size_t> list_pending;
+        if(resume_flag)
+        {
+            const bool finalized_flag = check_output_extract_size(list.file_long_prefix + ".bin", list.input_list->size(), desc_size);
+            consolidate_extract_journal(list.journal_file, list.journal_text_files);
+
+            vector<bool> done = read_extract_journal(list.journal_file, list.input_list->size());
+
+            // the text output of a committed template can not be told apart from other templates with the same images,
+            // so a template that fails the check can not be extracted again without writing its lines twice
+            size_t count_unverified = verify_output_extract(list.file_long_prefix + ".bin", list.input_list, desc_size, finalized_flag, done);
+            if(count_unverified)
+                throw runtime_error("can not resume extract, " + to_string(count_unverified) + " committed templates of " + list.file_long_prefix + ".bin do not match the input list or have a wrong size, extract it again without resume");
+
+            for(size_t i = 0; i < done.size(); i++)
+                if(!done[i])
+                    list_pending.push_back(i);
 
-        if(get_param<bool>(params["extract_info"]))
-            unique_ptr<ofstream> extract_info_stream = open_file_or_die<ofstream>(file_long_prefix + "_info.txt");
+            if(finalized_flag && !list_pending.empty())
+                throw runtime_error("can not resume extract, " + list.file_long_prefix + ".bin is finalized but " + to_string(list_pending.size()) + " templates are not committed, extract it again");
 
-        unique_ptr<ofstream> fail_detect_stream = open_file_or_die<ofstream>(file_long_prefix + "_fail.txt");
+            LOG(INFO) << "resume: " << list_name << " - " << list.input_list->size() - list_pending.size() << " templates already extracted, " << list_pending.size() << " left";
+        }
+        else
+        {
+            preallocate_output_extract(list.file_long_prefix + ".bin", list.input_list->size(), desc_size);
+
+            open_file_or_die<ofstream>(list.journal_file);
+            for(const string& text_file : list.text_files)
+                open_file_or_die<ofstream>(text_file);
+
+            for(size_t i = 0; i < list.input_list->size(); i++)
+                list_pending.push_back(i);
+        }
 
-        if(get_param<bool>(params["debug_info"]))
-            unique_ptr<ofstream> debug_info_stream = open_file_or_die<ofstream>(file_long_prefix + "_debug_info.txt");
+        input_lists.push_back(list.input_list);
+        pending.push_back(move(list_pending));
+        lists.push_back(move(list));
     }
 
-    uint count_proc = get_param<uint>(params["count_proc"]);
-    uint desc_size = get_param<uint>(params["desc_size"]);
+    // one scheduler over the templates of all lists, the same images in several lists are extracted once
+    extract_destinations_type destinations;
+    shared_ptr<const input_list_type> input_list = merge_input_extract(input_lists, pending, destinations);
+
+    size_t count_destinations = 0;
+    for(const auto& list_pending : pending)
+        count_destinations += list_pending.size();
 
-    size_t count_templ = 0;
-    auto input_list = read_input_extract(list_file, count_proc, count_templ);
+    LOG(INFO) << "templates to extract: " << count_destinations << " in " << lists.size() << " lists, " << input_list->size() << " unique";
+
+    LOG(INFO) << "count proc: " << count_proc;
+    LOG(INFO) << "templates per chunk: " << chunk_size;
+    LOG(INFO) << "decode threads per proc: " << decode_threads;
+    LOG(INFO) << "templates per write batch: " << write_batch;
+    LOG(INFO) << "templates per createTemplate batch: " << extract_batch;
+    LOG(INFO) << "pin cpus: " << get_param<string>(params["pin_cpus"]);
+    LOG(INFO) << "progress report interval, s: " << get_param<uint>(params["progress_interval"]);
+
+    if(bind_memory_flag && placements.empty())
+        LOG(WARNING) << "bind_memory requires pin_cpus, memory is not bound";
+
+    if(!write_batch)
+        throw logic_error("write batch size must be greater than 0");
+
+    if(!extract_batch)
+        throw logic_error("extract batch size must be greater than 0");
 
     string extract_prefix = get_abs(params["extract_prefix"], params) + "/";
     bool gray_flag = get_param<bool>(params["grayscale"]);
 
-    timing timer(true);
+    typename T_FACEAPI::ImageRequirements image_requirements;
+    {
+        typename T_FACEAPI::ReturnStatus status = face_api_ptr->getImageRequirements(image_requirements);
+
+        if(status.code != T_FACEAPI::ReturnCode::Success)
+            throw runtime_error("getImageRequirements failed, status: " + errcode_to_string(status.code));
+    }
 
-    in_out_desc_type output_desc;
-    vector< tuple<vector<string>, vector<typename T_FACEAPI::EyePair>, vector<double>> > extra_output;
-    fail_detect_type fail_detect;
+    if(reduced_decode_flag)
+        LOG(INFO) << "reduced JPEG decode down to the engine input size: " << image_requirements.maxWidth << "x" << image_requirements.maxHeight;
+    else
+        image_requirements.maxWidth = image_requirements.maxHeight = 0;
 
-    size_t counter = 0;
-    FreeImage_Initialise();
+    // the bitmaps are converted to the channel order the engine declares while they are copied out of FreeImage
+    const bitmap_layout layout = gray_flag ? bitmap_layout::gray
+                                           : (image_requirements.channelOrder == T_FACEAPI::ChannelOrder::BGR ? bitmap_layout::bgr : bitmap_layout::rgb);
 
-    string semaphore_name = "/FACEAPI_extract_" + to_string(getpid());
-    linux_scoped_mutex::remove(semaphore_name);
+    // the vectorized kernels must give the bytes of the scalar ones, a few thousand short rows are checked before any image
+    pixel_convert_self_check();
 
-    size_t fork_index = 0;
-    for(size_t i = 0; i < count_proc - 1; i++)
+    LOG(INFO) << "image layout: " << bitmap_layout_name(layout) << ", conversion kernels: " << pixel_convert_isa() << ", self-check passed";
+
+    unique_ptr<image_pack> pack;
+    const string image_pack_file = get_abs(params["image_pack"], params);
+    if(!image_pack_file.empty())
     {
-        if(fork() == 0)
+        pack.reset(new image_pack(image_pack_file));
+
+        if(pack->layout() != layout)
+            throw logic_error("image pack " + image_pack_file + " stores " + bitmap_layout_name(pack->layout()) + " images, the run needs "
+                              + bitmap_layout_name(layout) + ", build it with the same grayscale flag and channel order");
+
+        auto decode_size = [](size_t max_width, size_t max_height)
         {
-            fork_index = i + 1;
-            break;
-        }
+            return max_width || max_height ? "down to " + to_string(max_width) + "x" + to_string(max_height) : string("at full size");
+        };
+
+        // without reduced_decode the run decodes the images at full size, the requirements are zeroed above
+        if(pack->max_width() != image_requirements.maxWidth || pack->max_height() != image_requirements.maxHeight)
+            LOG(WARNING) << "image pack is decoded " << decode_size(pack->max_width(), pack->max_height()) << ", the run decodes the images "
+                         << decode_size(image_requirements.maxWidth, image_requirements.maxHeight);
+
+        if(image_cache_flag)
+            LOG(WARNING) << "image_cache is not used with image_pack";
+
+        LOG(INFO) << "image pack: " << pack->size() << " images from " << image_pack_file;
     }
 
-    if(fork_index < input_list->size())
+    FreeImage_Initialise();
+
+    // the most expensive templates first, so the workers finish at about the same time
+    unique_ptr<extract_scheduler> scheduler(cost_order_flag ? new extract_scheduler(order_input_extract_by_cost(*input_list, extract_prefix, count_proc), chunk_size)
+                                                            : new extract_scheduler(input_list->size(), chunk_size));
+
+    auto extract_worker = [&](size_t fork_index, extract_scheduler& worker_scheduler, bool write_flag, extract_progress* progress)
     {
-        size_t refusal_count = 0;
-        for(auto& batch_extract_list : (*input_list)[fork_index])
+        unique_ptr<scoped_worker_placement> placement;
+        if(!placements.empty())
+            placement.reset(new scoped_worker_placement(placements[fork_index], bind_memory_flag, fork_index));
+
+        timing timer(true);
+
+        struct list_output
+        {
+            desc_set output_desc;
+            extract_chunks_type chunks;
+            vector< tuple<vector<string>, vector<typename T_FACEAPI::EyePair>, vector<double>> > extra_output;
+            fail_detect_type fail_detect;
+        };
+
+        vector<list_output> outputs(lists.size());
+        for(list_output& output : outputs)
+            output.output_desc = desc_set(desc_size);
+
+        auto write_output = [&](size_t list_index)
         {
-            typename T_FACEAPI::Multiface template_images;
-            for(const string& path : batch_extract_list.first)
+            const extract_list& list = lists[list_index];
+            list_output& output = outputs[list_index];
+
+            if(output.chunks.empty())
+                return;
+
+            if(!write_flag)
             {
-                size_t bitmap_W = 0, bitmap_H = 0;
-                shared_ptr<uint8_t> bitmap = get_bitmap(extract_prefix + path, gray_flag, bitmap_W, bitmap_H);
-                template_images.emplace_back(static_cast<uint16_t>(bitmap_W), static_cast<uint16_t>(bitmap_H), gray_flag ? 8 : 24, bitmap);
+                output.output_desc.clear();
+                output.chunks.clear();
+                output.extra_output.clear();
+                output.fail_detect.clear();
+                return;
             }
 
-            vector<uint8_t> descriptor;
-            vector<typename T_FACEAPI::EyePair> eyeCoordinates;
-            vector<double> quality;
+            const auto twrite = high_resolution_clock::now();
+
+            write_output_extract(output.output_desc, list.file_long_prefix + ".bin", list.input_list, output.chunks, output.extra_output, shard_name(list.file_long_prefix + "_info.txt", fork_index),
+                        output.fail_detect, shard_name(list.file_long_prefix + "_fail.txt", fork_index), debug_info_flag, shard_name(list.file_long_prefix + "_debug_info.txt", fork_index), desc_size);
+
+            append_extract_journal(shard_name(list.journal_file, fork_index), output.chunks, {shard_name(list.journal_text_files[0], fork_index),
+                        shard_name(list.journal_text_files[1], fork_index), shard_name(list.journal_text_files[2], fork_index)});
+
+            if(progress)
+                progress->add_time(extract_stage::write, high_resolution_clock::now() - twrite);
+
+            output.output_desc.clear();
+            output.chunks.clear();
+            output.extra_output.clear();
+            output.fail_detect.clear();
+        };
+
+        size_t counter = 0;
+        size_t refusal_count = 0;
+
+        // the sweep decodes every image at every step, a cache filled by the first step would speed up the later ones
+        unique_ptr<image_cache> cache;
+        if(image_cache_flag && !pack && write_flag)
+            cache.reset(new image_cache(output_dir + "/image_cache"));
+
+        // bitmaps in the decode queue, in the createTemplate batch and in the decode threads
+        bitmap_pool pool(decode_queue + extract_batch + decode_threads + 1);
+
+        decode_pipeline<typename T_FACEAPI::Multiface> decoder(worker_scheduler, input_list, extract_prefix, layout, image_requirements.maxWidth, image_requirements.maxHeight, decode_threads, decode_queue, cache.get(), &pool, progress, pack.get());
+
+        // the decode threads keep the cpus of the node, only the thread calling createTemplate takes the cpus of the worker
+        if(placement)
+            placement->pin_worker_cpus();
+
+        vector<size_t> batch_indices;
+        vector<typename T_FACEAPI::Multiface> batch_images;
+        nanoseconds batch_time_acc(0);
+
+        auto extract_batch_templates = [&]()
+        {
+            if(batch_images.empty())
+                return;
+
+            vector<vector<uint8_t>> descriptors;
+            vector<vector<typename T_FACEAPI::EyePair>> eyeCoordinates;
+            vector<vector<double>> quality;
+            vector<typename T_FACEAPI::ReturnStatus> statuses;
 
             timer.start();
-            typename T_FACEAPI::ReturnStatus status = createTemplateParam(face_api_ptr, template_images, T_FACEAPI::TemplateRole::Init_V, descriptor, eyeCoordinates, quality);
-            timer.stop();
+            typename T_FACEAPI::ReturnStatus batch_status = createTemplateBatchParam(face_api_ptr, batch_images, T_FACEAPI::TemplateRole::Init_V, descriptors, eyeCoordinates, quality, statuses);
+            const nanoseconds batch_time = timer.stop();
+            batch_time_acc += batch_time;
 
-            if(status.code == T_FACEAPI::ReturnCode::RefuseInput)
-            {
-                batch_extract_list.second *= -1;
-                descriptor.assign(desc_size, 0);
-                refusal_count++;
+            if(progress)
+                progress->add_time(extract_stage::create_template, batch_time);
 
-                fail_detect.push_back(batch_extract_list.first);
-            }
-            else
+            if(batch_status.code != T_FACEAPI::ReturnCode::Success)
+                throw runtime_error("createTemplateBatch failed, status: " + errcode_to_string(batch_status.code));
+
+            if(statuses.size() != batch_images.size() || descriptors.size() != batch_images.size() || eyeCoordinates.size() != batch_images.size() || quality.size() != batch_images.size())
+                throw runtime_error("createTemplateBatch returned " + to_string(statuses.size()) + " results for " + to_string(batch_images.size()) + " templates");
+
+            for(size_t i = 0; i < batch_indices.size(); i++)
             {
-                if(status.code != T_FACEAPI::ReturnCode::Success)
-                {
-                    string images_paths;
-                    for(const string& path: batch_extract_list.first)
-                        images_paths += path + " ";
+                const size_t merged_index = batch_indices[i];
+                const vector<string>& template_paths = (*input_list)[merged_index].first;
+                vector<uint8_t>& descriptor = descriptors[i];
+                typename T_FACEAPI::ReturnStatus& status = statuses[i];
+                bool refused = false;
 
-                    throw runtime_error("createTemplate failed, status: " + errcode_to_string(status.code)
-                                             + ", template images: " + images_paths);
+                if(status.code == T_FACEAPI::ReturnCode::RefuseInput)
+                {
+                    refused = true;
+                    descriptor.clear();
+                    refusal_count++;
                 }
                 else
                 {
-                    if(descriptor.size() != desc_size)
-                        throw runtime_error("wrong descriptor size: " + to_string(descriptor.size()) + " vs " + to_string(desc_size));
+                    if(status.code != T_FACEAPI::ReturnCode::Success)
+                    {
+                        string images_paths;
+                        for(const string& path: template_paths)
+                            images_paths += path + " ";
+
+                        throw runtime_error("createTemplate failed, status: " + errcode_to_string(status.code)
+                                                 + ", template images: " + images_paths);
+                    }
+                    else
+                    {
+                        if(descriptor.empty() || descriptor.size() > desc_size)
+                            throw runtime_error("wrong descriptor size: " + to_string(descriptor.size()) + ", expected 1 to " + to_string(desc_size));
+                    }
+                }
+
+                for(const auto& destination : destinations[merged_index])
+                {
+                    const size_t list_index = destination.first;
+                    const size_t templ_index = destination.second;
+                    list_output& output = outputs[list_index];
+
+                    if(!output.chunks.empty() && output.chunks.back().second == templ_index)
+                        output.chunks.back().second++;
+                    else
+                        output.chunks.emplace_back(templ_index, templ_index + 1);
+
+                    int label = (*lists[list_index].input_list)[templ_index].second;
+
+                    if(refused)
+                    {
+                        label *= -1;
+                        output.fail_detect.push_back(template_paths);
+                    }
+
+                    if(extract_info_flag)
+                        output.extra_output.push_back(make_tuple(template_paths, eyeCoordinates[i], quality[i]));
+
+                    output.output_desc.push_back(label, descriptor.data(), descriptor.size());
+
+                    if(output.output_desc.size() >= write_batch)
+                        write_output(list_index);
                 }
+
+                counter++;
+                if(progress)
+                    progress->add_templates(1);
             }
 
-            if(get_param<bool>(params["extract_info"]))
-                extra_output.push_back(make_tuple(batch_extract_list.first, eyeCoordinates, quality));
+            batch_indices.clear();
+            batch_images.clear();
+        };
 
-            output_desc.push_back({batch_extract_list.second, move(descriptor)});
+        size_t templ_index = 0;
+        typename T_FACEAPI::Multiface template_images;
+        while(decoder.pop(templ_index, template_images))
+        {
+            batch_indices.push_back(templ_index);
+            batch_images.push_back(move(template_images));
 
-            counter++;
-            if(counter % 100 == 0)
-                LOG(INFO) << "proc " << fork_index << " - extract " << counter << " descriptors";
+            if(batch_images.size() >= extract_batch)
+                extract_batch_templates();
         }
-        FreeImage_DeInitialise();
 
-        write_output_extract(output_desc, file_long_prefix + ".bin", semaphore_name, input_list, fork_index, extra_output,  file_long_prefix + "_info.txt",
-                    fail_detect, file_long_prefix + "_fail.txt", get_param<bool>(params["debug_info"]), file_long_prefix + "_debug_info.txt", desc_size);
+        extract_batch_templates();
+        for(size_t list_index = 0; list_index < lists.size(); list_index++)
+            write_output(list_index);
 
         LOG(INFO) << "proc " << fork_index << " - extract count: " << counter;
+        decoder.log_stats(fork_index);
+        if(cache)
+            cache->log_stats(fork_index);
 
         if(refusal_count)
             LOG(WARNING) << "proc " << fork_index << " - REFUSAL count: " << refusal_count;
 
-        LOG(INFO) << "proc " << fork_index << " - createTemplate done, average time - " << duration_to_string(duration<double, milli>(timer.get_average()));
-        if(get_param<bool>(params["extra_timings"]))
-            log_extended_info(timing::extended_info_cast<double, milli>(timer.get_extended_info(get_param<uint>(params["percentile"]) / 100.f)), static_cast<int>(fork_index));
+        const nanoseconds template_average = counter ? batch_time_acc / static_cast<nanoseconds::rep>(counter) : nanoseconds(0);
+        LOG(INFO) << "proc " << fork_index << " - createTemplate done, average time - " << duration_to_string(duration<double, milli>(template_average));
+        if(extract_batch > 1)
+            LOG(INFO) << "proc " << fork_index << " - createTemplateBatch of up to " << extract_batch << " templates, average batch time - " << duration_to_string(duration<double, milli>(timer.get_average()));
+        if(extra_timings_flag)
+            log_extended_info(timing::extended_info_cast<double, milli>(timer.get_extended_info(percentile)), static_cast<int>(fork_index));
+    };
+
+    auto run_workers = [&](size_t count_workers, extract_scheduler& run_scheduler, bool write_flag, extract_progress* progress)
+    {
+        if(threads_flag)
+        {
+            vector<thread> workers;
+            vector<exception_ptr> errors(count_workers);
+
+            for(size_t i = 1; i < count_workers; i++)
+                workers.emplace_back([&, i]()
+                {
+                    try
+                    {
+                        extract_worker(i, run_scheduler, write_flag, progress);
+                    }
+                    catch(...)
+                    {
+                        errors[i] = current_exception();
+                    }
+                });
+
+            try
+            {
+                extract_worker(0, run_scheduler, write_flag, progress);
+            }
+            catch(...)
+            {
+                errors[0] = current_exception();
+            }
+
+            wait_all_threads(workers, errors);
+        }
+        else
+        {
+            size_t fork_index = 0;
+            for(size_t i = 0; i < count_workers - 1; i++)
+            {
+                if(fork() == 0)
+                {
+                    fork_index = i + 1;
+                    break;
+                }
+            }
+
+            extract_worker(fork_index, run_scheduler, write_flag, progress);
+
+            if(fork_index != 0)
+                exit(0);
+
+            wait_all_forks();
+        }
+    };
+
+    if(sweep_mode != "none" && (!sweep_sample || input_list->empty()))
+        LOG(WARNING) << "scaling sweep skipped, no templates to sample";
+    else if(sweep_mode != "none")
+    {
+        const size_t count_sample = min<size_t>(sweep_sample, input_list->size());
+
+        // templates evenly spread over the lists, or over the templates left to resume
+        vector<size_t> sample;
+        vector<string> sample_files;
+        for(size_t i = 0; i < count_sample; i++)
+        {
+            sample.push_back(i * input_list->size() / count_sample);
+
+            for(const string& path : (*input_list)[sample.back()].first)
+                sample_files.push_back(extract_prefix + path);
+        }
+
+        read_to_page_cache(sample_files);
+
+        vector<uint> sweep_counts;
+        for(uint count_workers = 1; count_workers < count_proc; count_workers *= 2)
+            sweep_counts.push_back(count_workers);
+        sweep_counts.push_back(count_proc);
+
+        vector<double> throughputs;
+        for(uint count_workers : sweep_counts)
+        {
+            LOG(INFO) << "scaling sweep: " << count_workers << " workers on " << count_sample << " templates...";
+
+            extract_scheduler sweep_scheduler(sample, chunk_size);
+
+            timing sweep_timer;
+            sweep_timer.start();
+            run_workers(count_workers, sweep_scheduler, false, nullptr);
+            const double interval = duration<double, sec_t>(sweep_timer.stop()).count();
+
+            throughputs.push_back(count_sample / interval);
+        }
+
+        const uint best_count_proc = log_scaling_sweep(sweep_counts, throughputs);
+
+        if(sweep_mode == "apply")
+        {
+            count_proc = best_count_proc;
+            LOG(INFO) << "scaling sweep: count proc set to " << count_proc;
+        }
+    }
+
+    for(const extract_list& list : lists)
+    {
+        for(uint i = 0; i < count_proc; i++)
+        {
+            open_file_or_die<ofstream>(shard_name(list.journal_file, i));
+            for(const string& text_file : list.text_files)
+                open_file_or_die<ofstream>(shard_name(text_file, i));
+        }
     }
 
-    if(fork_index != 0)
-        exit(0);
+    extract_progress progress(input_list->size(), seconds(get_param<uint>(params["progress_interval"])));
 
-    wait_all_forks();
+    run_workers(count_proc, *scheduler, true, &progress);
+    FreeImage_DeInitialise();
+
+    progress.log_summary();
+
+    for(const extract_list& list : lists)
+    {
+        for(const string& text_file : list.text_files)
+            merge_shards(text_file, count_proc);
+        merge_shards(list.journal_file, count_proc);
+    }
 
-    if(create_manifest_flag)
-        write_manifest(output_dir + "/manifest.txt", file_long_prefix + ".bin", desc_size);
+    for(size_t list_index = 0; list_index < lists.size(); list_index++)
+        finalize_output_extract(lists[list_index].file_long_prefix + ".bin", list_names[list_index] == manifest_list_name ? output_dir + "/manifest.txt" : "");
 }
@@ -29,6 +29,21 @@ void FACEAPI_extract(shared_ptr<IdentInterface> face_api_ptr, params_type& param
  */
 ReturnStatus createTemplateParam(shared_ptr<IdentInterface> face_api_ptr, const Multiface &faces, TemplateRole role, vector<uint8_t> &templ, vector<EyePair> &eyeCoordinates, vector<double>&);
 
+/*!
+ * \brief Calls the createTemplateBatch function of the IdentInterface to create templates for a batch of faces.
+ *
+ * \param face_api_ptr A shared_ptr to an instance of IdentInterface representing the FACEAPI for identification.
+ * \param faces A constant reference to a vector of Multiface objects, one per template.
+ * \param role A TemplateRole representing the role of the templates.
+ * \param templs A reference to a vector where the created templates will be stored.
+ * \param eyeCoordinates A reference to a vector where the eye coordinates of each template will be stored.
+ * \param quality A reference to a vector of the quality values of each template (Cleared, not provided by the IdentInterface).
+ * \param statuses A reference to a vector where the status of each template creation will be stored.
+ *
+ * \return A ReturnStatus indicating the status of the batch.
+ */
+ReturnStatus createTemplateBatchParam(shared_ptr<IdentInterface> face_api_ptr, const vector<Multiface> &faces, TemplateRole role, vector<vector<uint8_t>> &templs, vector<vector<EyePair>> &eyeCoordinates, vector<vector<double>> &quality, vector<ReturnStatus> &statuses);
+
 class FACEAPI
 {
 public:
@@ -44,3 +44,18 @@ void FACEAPI_ROC(const string& output_dir);
  * \return The ReturnStatus indicating the success or failure of the template creation.
  */
 ReturnStatus createTemplateParam(shared_ptr<Interface> face_api_ptr, const Multiface &faces, TemplateRole role, vector<uint8_t> &templ, vector<EyePair> &eyeCoordinates, vector<double> &quality);
+
+/*!
+ * \brief Create face templates for a batch of multiple face images with additional parameters.
+ *
+ * \param face_api_ptr A shared pointer to the Interface class.
+ * \param faces The batch of Multiface objects, one per template.
+ * \param role The TemplateRole indicating the role of the templates.
+ * \param templs Output parameter for the created face templates.
+ * \param eyeCoordinates Output parameter for the eye coordinates of each template.
+ * \param quality Output parameter for the quality values of each template.
+ * \param statuses Output parameter for the status of each template creation.
+ *
+ * \return The ReturnStatus indicating the success or failure of the batch.
+ */
+ReturnStatus createTemplateBatchParam(shared_ptr<Interface> face_api_ptr, const vector<Multiface> &faces, TemplateRole role, vector<vector<uint8_t>> &templs, vector<vector<EyePair>> &eyeCoordinates, vector<vector<double>> &quality, vector<ReturnStatus> &statuses);
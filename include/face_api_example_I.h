@@ -44,6 +44,16 @@ public:
         std::vector<uint8_t> &templ,
         std::vector<FACEAPITEST::EyePair> &eyeCoordinates) override;
 
+    /*!
+     * \brief Get the requirements to the input images, the detector works on 320x320 images.
+     *
+     * \param requirements The output structure to store the requirements.
+     *
+     * \return A `ReturnStatus` object indicating the success of the call.
+     */
+    FACEAPITEST::ReturnStatus
+    getImageRequirements(FACEAPITEST::ImageRequirements &requirements) override;
+
     /*!
      * \brief Finalizes the initialization of the face recognition system.
      *
@@ -41,6 +41,26 @@ public:
             std::vector<FACEAPITEST::EyePair> &eyeCoordinates,
             std::vector<double> &quality) override;
 
+    /*!
+     * \brief Get the requirements to the input images, the detector works on 320x320 images.
+     *
+     * \param requirements The output structure to store the requirements.
+     *
+     * \return A `ReturnStatus` object indicating the success of the call.
+     */
+    FACEAPITEST::ReturnStatus
+    getImageRequirements(FACEAPITEST::ImageRequirements &requirements) override;
+
+    /*!
+     * \brief Get the layout of the templates, they are the 128 float features of SFace compared by cosine.
+     *
+     * \param layout The output structure to store the layout.
+     *
+     * \return A `ReturnStatus` object indicating the success of the call.
+     */
+    FACEAPITEST::ReturnStatus
+    getTemplateLayout(FACEAPITEST::TemplateLayout &layout) override;
+
     /*!
      * \brief Match two face templates to calculate their similarity score.
      *
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "utils.h"
+#include "bitmap_pool.h"
+#include "pixel_convert.h"
+
+using namespace std;
+
+/*!
+ * \brief On-disk cache of decoded images shared across benchmark runs.
+ *
+ * Each decoded image is stored in its own file, named by a hash of the image path, the pixel
+ * layout and the reduced decode size, the image mtime and size are checked on load. Cached images are
+ * mapped with MAP_PRIVATE, so the bitmap is fed straight from the page cache and a vendor modifying
+ * Image::data in place only touches its own copy-on-write pages. Files are written under a temporary name and renamed, so extract workers
+ * can fill the cache concurrently.
+ */
+class image_cache
+{
+
+public:
+    /*!
+     * \brief Open the cache directory, create it if needed.
+     *
+     * \param cache_dir The directory of the cache files.
+     */
+    image_cache(const string& cache_dir);
+
+    image_cache(const image_cache&) = delete;
+    image_cache& operator=(const image_cache&) = delete;
+
+    /*!
+     * \brief Get the bitmap of an image from the cache, decode and store it on a miss.
+     *
+     * \param file The file path of the image.
+     * \param layout The pixel layout of the bitmap: RGB, BGR or grayscale.
+     * \param width Reference to store the width of the bitmap.
+     * \param height Reference to store the height of the bitmap.
+     * \param max_width The width the engine makes use of, see get_bitmap().
+     * \param max_height The height the engine makes use of, see get_bitmap().
+     * \param pool The pool to take the bitmap buffer from on a miss, nullptr to allocate it.
+     * \param timings The timings to add the stage times to, a hit counts as read, nullptr to skip timing.
+     *
+     * \return A shared_ptr to the bitmap data, the same bytes get_bitmap() returns.
+     */
+    shared_ptr<uint8_t> get_bitmap(const string& file, bitmap_layout layout, size_t& width, size_t& height, size_t max_width = 0, size_t max_height = 0, bitmap_pool* pool = nullptr, bitmap_timings* timings = nullptr);
+
+    /*!
+     * \brief Log the hit and miss counts of the cache.
+     *
+     * \param fork_index The index of the extract worker.
+     */
+    void log_stats(size_t fork_index) const;
+
+private:
+    struct file_header
+    {
+        char magic[8];
+        uint64_t mtime_sec;
+        uint64_t mtime_nsec;
+        uint64_t file_size;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t max_width;
+        uint32_t max_height;
+        uint32_t path_size;
+    };
+
+    shared_ptr<uint8_t> load(const string& cache_file, const file_header& expected, const string& file, size_t& width, size_t& height) const;
+    void store(const string& cache_file, const file_header& header, const string& file, const uint8_t* bitmap) const;
+
+    string m_cache_dir;
+    atomic<size_t> m_hits;
+    atomic<size_t> m_misses;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "utils.h"
+
+using namespace std;
+
+/*!
+ * \brief Container of pre-decoded images, mapped into memory instead of opening and decoding image files.
+ *
+ * The file holds a header, the raw bitmaps as get_bitmap() returns them, each aligned to 64 bytes,
+ * an index of (offset, width, height, depth) per image and the image paths relative to extract_prefix.
+ * The file is mapped with MAP_PRIVATE, Image::data aliases the mapping, so the extract stage does no
+ * file opens, no decode and no copy, and a vendor modifying Image::data in place only touches its own
+ * copy-on-write pages.
+ */
+class image_pack
+{
+
+public:
+    /*!
+     * \brief Map a pack file and build the index of its images.
+     *
+     * \param pack_file The file path of the pack.
+     */
+    image_pack(const string& pack_file);
+
+    image_pack(const image_pack&) = delete;
+    image_pack& operator=(const image_pack&) = delete;
+
+    /*!
+     * \brief Get the bitmap of an image from the pack.
+     *
+     * \param path The path of the image relative to extract_prefix, as in the extract list.
+     * \param width Reference to store the width of the bitmap.
+     * \param height Reference to store the height of the bitmap.
+     *
+     * \return A shared_ptr to the bitmap data in the mapping, the same bytes get_bitmap() returns.
+     */
+    shared_ptr<uint8_t> get_bitmap(const string& path, size_t& width, size_t& height) const;
+
+    /*!
+     * \brief Get the pixel layout the images are stored in.
+     *
+     * \return The layout: 24-bit RGB, 24-bit BGR or 8-bit grayscale.
+     */
+    bitmap_layout layout() const;
+
+    /*!
+     * \brief Get the width JPEG images were decoded at a reduced scale down to, see get_bitmap().
+     *
+     * \return The width, 0 - full resolution.
+     */
+    size_t max_width() const;
+
+    /*!
+     * \brief Get the height JPEG images were decoded at a reduced scale down to, see get_bitmap().
+     *
+     * \return The height, 0 - full resolution.
+     */
+    size_t max_height() const;
+
+    /*!
+     * \brief Get the count of images in the pack.
+     *
+     * \return The count of images.
+     */
+    size_t size() const;
+
+    /*!
+     * \brief Decode images and write them to a pack file.
+     *
+     * \param pack_file The file path of the pack.
+     * \param paths The paths of the images relative to extract_prefix, duplicates are stored once.
+     * \param extract_prefix The path prefix of the image files.
+     * \param layout The pixel layout to store the images in: RGB, BGR or grayscale.
+     * \param max_width The width to decode JPEG images at a reduced scale down to, see get_bitmap() (0 - no limit).
+     * \param max_height The height to decode JPEG images at a reduced scale down to, see get_bitmap() (0 - no limit).
+     * \param count_threads The count of decode threads.
+     */
+    static void write(const string& pack_file, const vector<string>& paths, const string& extract_prefix, bitmap_layout layout, size_t max_width, size_t max_height, uint count_threads);
+
+private:
+    struct file_header
+    {
+        char magic[8];
+        uint64_t count_images;
+        uint64_t index_offset;
+        uint64_t paths_offset;
+        uint32_t channels;
+        uint32_t max_width;
+        uint32_t max_height;
+        uint32_t layout;
+    };
+
+    struct index_entry
+    {
+        uint64_t data_offset;
+        uint64_t path_offset;
+        uint32_t path_size;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+    };
+
+    shared_ptr<uint8_t> m_mapping;
+    file_header m_header;
+    unordered_map<string, const index_entry*> m_index;
+};
@@ -1,19 +1,22 @@
 #pragma once
 
-#include <semaphore.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <map>
 #include <memory>
+#include <cstring>
 #include <vector>
 #include <fstream>
 
 #include "utils.h"
+#include "desc_file.h"
 
 using namespace std;
 
-typedef vector< vector<pair<vector<string>, int>> > input_list_type;
-typedef vector<pair<int, vector<uint8_t>>> in_out_desc_type;
+typedef vector<pair<vector<string>, int>> input_list_type;
+typedef vector<pair<size_t, size_t>> extract_chunks_type;
+typedef vector<vector<pair<size_t, size_t>>> extract_destinations_type;
 typedef vector<vector<string>> fail_detect_type;
 typedef pair<vector<float>, vector<float>> matches_type;
 
@@ -21,54 +24,172 @@ typedef pair<vector<float>, vector<float>> matches_type;
  * \brief Read input for extraction and create shared_ptr to input_list_type.
  *
  * \param file The file path containing the input data.
- * \param count_proc The number of extraction processes.
- * \param count_templ Output parameter to store the count of templates read.
  *
- * \return A shared_ptr to input_list_type containing the read input data.
+ * \return A shared_ptr to input_list_type containing the read templates in output order.
  */
-shared_ptr<input_list_type> read_input_extract(const string& file, uint count_proc, size_t& count_templ);
+shared_ptr<input_list_type> read_input_extract(const string& file);
 
 template<typename T_EyePair>
 /*!
  * \brief Write extraction output and related information to files.
  *
- * \param output The in_out_desc_type containing the extraction output data.
- * \param file_desc The file path to write the descriptor data.
- * \param semaphore_name The name of the semaphore to lock during writing.
- * \param input_list A shared_ptr to input_list_type containing the input data (not used in this function).
- * \param fork_index The index of the forked process (not used in this function).
+ * \param output The desc_set containing the extraction output data.
+ * \param file_desc The descriptors file path to write the labels and descriptors to, created by preallocate_output_extract.
+ * \param input_list A shared_ptr to input_list_type containing the input data, its size is the count of templates in the file.
+ * \param chunks The template index ranges processed by the worker, output is stored in the same order.
  * \param extra_output A vector of tuples containing additional output data (not used in this function).
- * \param file_extra The file path to write the additional output data (not used in this function).
+ * \param file_extra The worker shard file path to append the additional output data.
  * \param fail_detect The fail_detect_type containing the failed detection data (not used in this function).
- * \param file_fail The file path to write the failed detection data (not used in this function).
+ * \param file_fail The worker shard file path to append the failed detection data.
  * \param debug_flag A boolean flag indicating whether to enable debug output (not used in this function).
- * \param file_debug The file path to write the debug output (not used in this function).
- * \param desc_size The descriptor size (not used in this function).
+ * \param file_debug The worker shard file path to append the debug output.
+ * \param desc_size The maximum descriptor size, the slot size of the output.
  */
-void write_output_extract(const in_out_desc_type& output, const string& file_desc, const string& semaphore_name, shared_ptr<const input_list_type> input_list, size_t fork_index,
+void write_output_extract(const desc_set& output, const string& file_desc, shared_ptr<const input_list_type> input_list, const extract_chunks_type& chunks,
                   const vector< tuple<vector<string>, vector<T_EyePair>, vector<double>> >& extra_output, const string& file_extra, const fail_detect_type& fail_detect, const string& file_fail, bool debug_flag, const string& file_debug, uint desc_size);
 
 /*!
- * \brief Write a manifest file based on the descriptors read from the desc_file.
+ * \brief Create the descriptor file with its final size, so extract workers can write to their offsets without locking.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param count_templ The count of templates in the input list.
+ * \param desc_size The maximum descriptor size.
+ */
+void preallocate_output_extract(const string& file_desc, size_t count_templ, uint desc_size);
+
+/*!
+ * \brief Store the refusal count and the checksum in the header of the descriptor file once all extract workers are done.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param manifest_file The file path to write the manifest of the descriptor file to, empty for none.
+ */
+void finalize_output_extract(const string& file_desc, const string& manifest_file = "");
+
+/*!
+ * \brief Write a buffer to a file descriptor at the given offset or throw an exception.
+ *
+ * \param fd The file descriptor to write to.
+ * \param data The data to write.
+ * \param size The size of the data in bytes.
+ * \param offset The file offset to write the data at.
+ * \param file The file path used in the error message.
+ */
+void pwrite_or_die(int fd, const void* data, size_t size, size_t offset, const string& file);
+
+/*!
+ * \brief Get the file path of an extract worker shard of a text output file.
+ *
+ * \param file The file path of the merged output file.
+ * \param fork_index The index of the extract worker.
+ *
+ * \return The file path of the worker shard.
+ */
+string shard_name(const string& file, size_t fork_index);
+
+/*!
+ * \brief Append the extract worker shards to the output file in the worker order and remove them.
+ *
+ * \param file The file path of the merged output file.
+ * \param count_proc The count of extract workers.
+ */
+void merge_shards(const string& file, uint count_proc);
+
+/*!
+ * \brief Check that an existing descriptor file was created for the input list, so an interrupted extract can be resumed.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param count_templ The count of templates in the input list.
+ * \param desc_size The maximum descriptor size.
+ *
+ * \return 'true' if the descriptor file is already finalized.
+ */
+bool check_output_extract_size(const string& file_desc, size_t count_templ, uint desc_size);
+
+/*!
+ * \brief Append the chunks committed by an extract worker to its journal shard.
+ *
+ * \param journal_file The worker shard file path of the journal.
+ * \param chunks The template index ranges written to the descriptor file.
+ * \param text_shards The worker shard file paths of the text output files, their sizes are recorded with the commit.
+ */
+void append_extract_journal(const string& journal_file, const extract_chunks_type& chunks, const vector<string>& text_shards);
+
+/*!
+ * \brief Cut the worker shards of an interrupted extract run to their last commit and merge them into the main files.
+ *
+ * \param journal_file The file path of the merged journal.
+ * \param text_files The file paths of the merged text output files, in the order their sizes are recorded in the journal.
+ */
+void consolidate_extract_journal(const string& journal_file, const vector<string>& text_files);
+
+/*!
+ * \brief Read the merged journal and mark the templates already written to the descriptor file.
+ *
+ * \param journal_file The file path of the merged journal.
+ * \param count_templ The count of templates in the input list.
+ *
+ * \return A vector of flags, 'true' for each committed template.
+ */
+vector<bool> read_extract_journal(const string& journal_file, size_t count_templ);
+
+/*!
+ * \brief Check the labels and descriptor sizes of the committed templates in the descriptor file.
+ *
+ * A committed template must have the label of the input list, negative if it was refused, and a size
+ * entry of 0 for a refusal and of 1 to desc_size otherwise.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param input_list A shared_ptr to input_list_type containing the input data.
+ * \param desc_size The maximum descriptor size.
+ * \param finalized_flag Flag to indicate whether the descriptor file is finalized, its table then holds offsets instead of sizes.
+ * \param done The committed template flags, cleared for templates that failed the check.
+ *
+ * \return The count of committed templates that failed the check.
+ */
+size_t verify_output_extract(const string& file_desc, shared_ptr<const input_list_type> input_list, uint desc_size, bool finalized_flag, vector<bool>& done);
+
+/*!
+ * \brief Write a manifest file with the sizes and offsets of the descriptors in the descriptor file, computed from the offset table without reading the descriptors.
  *
  * \param out_file The file path to write the manifest data.
- * \param desc_file The file path containing the descriptor data.
- * \param desc_size The descriptor size.
+ * \param labels The labels of all templates of the descriptor file, negative for refused ones.
+ * \param offsets The offsets of the descriptors from the beginning of the descriptor file, one more than the labels.
  */
-void write_manifest(const string& out_file, const string& desc_file, uint desc_size);
+void write_manifest(const string& out_file, const vector<int>& labels, const vector<uint64_t>& offsets);
 
 /*!
- * \brief Read input for match or search and create shared_ptr to in_out_desc_type.
+ * \brief Merge the pending templates of several input lists into one list, templates with the same image paths are extracted once.
+ *
+ * \param input_lists The input lists.
+ * \param pending The indices of the pending templates of each input list, in ascending order.
+ * \param destinations The (list index, template index) pairs each merged template is written to.
+ *
+ * \return A shared_ptr to input_list_type containing the merged templates in order of the first appearance, labels are not set.
+ */
+shared_ptr<input_list_type> merge_input_extract(const vector<shared_ptr<input_list_type>>& input_lists, const vector<vector<size_t>>& pending, extract_destinations_type& destinations);
+
+/*!
+ * \brief Order templates by decreasing cost, estimated as the count of pixels of their images read from the image headers.
+ *
+ * \param input_list The templates.
+ * \param extract_prefix The path prefix of the image files.
+ * \param count_threads The count of threads reading the image headers.
+ *
+ * \return The template indices, the most expensive first, ties in input order.
+ */
+vector<size_t> order_input_extract_by_cost(const input_list_type& input_list, const string& extract_prefix, uint count_threads);
+
+/*!
+ * \brief Map the descriptor file for match or search and check it against its checksum.
  *
  * \param file The file path containing the input data.
- * \param desc_size The descriptor size.
- * \param match_log A boolean flag indicating whether to log match count (not used in this function).
- * \param log_prefix The log prefix to use in case of logging (not used in this function).
- * \param counters_file The file path to write the count of descriptors and refusals (not used in this function).
+ * \param match_log A boolean flag indicating whether to log match count.
+ * \param log_prefix The log prefix to use in case of logging.
+ * \param counters_file The file path to write the count of descriptors and refusals, empty for none.
  *
- * \return A shared_ptr to in_out_desc_type containing the read input data.
+ * \return A shared_ptr to the desc_set viewing the mapped file.
  */
-shared_ptr<in_out_desc_type> read_input_match_search(const string& file, uint desc_size, bool match_log, const string& log_prefix = "", const string& counters_file = "");
+shared_ptr<const desc_set> read_input_match_search(const string& file, bool match_log, const string& log_prefix = "", const string& counters_file = "");
 
 /*!
  * \brief Write match or search output to a binary file.
@@ -103,122 +224,115 @@ void write_output_ROC_tpir(const string& file, const vector<int>& fprs, const ve
 //-----------------------------------------------------------------------Template Implementation-----------------------------------------------------------------------------------
 
 
-class linux_scoped_mutex
-{
-private:
-    sem_t* m_sem = nullptr;
-
-public:
-    linux_scoped_mutex(const string& name)
-    {
-        m_sem = sem_open(name.c_str(), O_CREAT, 0777, 1);
-        sem_wait(m_sem);
-    }
-
-    ~linux_scoped_mutex()
-    {
-        sem_post(m_sem);
-        sem_close(m_sem);
-    }
-
-    static void remove(const string& name)
-    {
-        sem_unlink(name.c_str());
-    }
-};
-
 template<typename T_EyePair>
 /*!
  * \brief Write extraction output and related information to files.
  *
- * \param output The in_out_desc_type containing the extraction output data.
- * \param file_desc The file path to write the descriptor data.
- * \param semaphore_name The name of the semaphore to lock during writing.
- * \param input_list A shared_ptr to input_list_type containing the input data (not used in this function).
- * \param fork_index The index of the forked process (not used in this function).
+ * \param output The desc_set containing the extraction output data.
+ * \param file_desc The descriptors file path to write the labels and descriptors to, created by preallocate_output_extract.
+ * \param input_list A shared_ptr to input_list_type containing the input data, its size is the count of templates in the file.
+ * \param chunks The template index ranges processed by the worker, output is stored in the same order.
  * \param extra_output A vector of tuples containing additional output data (not used in this function).
- * \param file_extra The file path to write the additional output data (not used in this function).
+ * \param file_extra The worker shard file path to append the additional output data.
  * \param fail_detect The fail_detect_type containing the failed detection data (not used in this function).
- * \param file_fail The file path to write the failed detection data (not used in this function).
+ * \param file_fail The worker shard file path to append the failed detection data.
  * \param debug_flag A boolean flag indicating whether to enable debug output (not used in this function).
- * \param file_debug The file path to write the debug output (not used in this function).
- * \param desc_size The descriptor size (not used in this function).
+ * \param file_debug The worker shard file path to append the debug output.
+ * \param desc_size The maximum descriptor size, the slot size of the output.
  */
-void write_output_extract(const in_out_desc_type& output, const string& file_desc, const string& semaphore_name, shared_ptr<const input_list_type> input_list, size_t fork_index,
+void write_output_extract(const desc_set& output, const string& file_desc, shared_ptr<const input_list_type> input_list, const extract_chunks_type& chunks,
                   const vector< tuple<vector<string>, vector<T_EyePair>, vector<double>> >& extra_output, const string& file_extra, const fail_detect_type& fail_detect, const string& file_fail, bool debug_flag, const string& file_debug, uint desc_size)
 {
-    linux_scoped_mutex mtx(semaphore_name);
-    {
-        if(output.size() != (*input_list)[fork_index].size())
-            throw runtime_error("invalid output size");
+    size_t chunks_size = 0;
+    for(const auto& chunk : chunks)
+        chunks_size += chunk.second - chunk.first;
 
-        FILE* desc_bin_file = fopen(file_desc.c_str(), "r+");
+    if(output.size() != chunks_size || output.slot_size() != desc_size)
+        throw runtime_error("invalid output size");
 
-        if(!desc_bin_file)
-            throw runtime_error("failed to open " + file_desc);
+    int desc_bin_fd = open(file_desc.c_str(), O_WRONLY);
 
-        size_t write_pos = 0;
-        for(size_t i = 0; i < fork_index; i++)
-            write_pos += (*input_list)[i].size() * (sizeof(int) + desc_size);
-        fseek(desc_bin_file, static_cast<long>(write_pos), SEEK_SET);
+    if(desc_bin_fd < 0)
+        throw runtime_error("failed to open " + file_desc);
 
-        for(const auto& desc : output)
+    // output slots of a chunk are contiguous, so each chunk takes one write of its labels, one of its sizes and one of its slots
+    const size_t count_templ = input_list->size();
+
+    size_t output_pos = 0;
+    for(const auto& chunk : chunks)
+    {
+        const size_t chunk_size = chunk.second - chunk.first;
+
+        try
         {
-            fwrite(&desc.first, sizeof(desc.first), 1, desc_bin_file);
-            fwrite(desc.second.data(), desc.second.size() * sizeof(uint8_t), 1, desc_bin_file);
+            pwrite_or_die(desc_bin_fd, output.labels() + output_pos, chunk_size * sizeof(int), desc_file::label_offset(chunk.first), file_desc);
+            pwrite_or_die(desc_bin_fd, output.sizes() + output_pos, chunk_size * sizeof(uint64_t), desc_file::table_offset(count_templ, chunk.first), file_desc);
+            pwrite_or_die(desc_bin_fd, output.slots() + output_pos * desc_size, chunk_size * desc_size, desc_file::descriptor_offset(count_templ, desc_size, chunk.first), file_desc);
+        }
+        catch(...)
+        {
+            close(desc_bin_fd);
+            throw;
         }
 
-        fclose(desc_bin_file);
-        desc_bin_file = nullptr;
+        output_pos += chunk_size;
+    }
 
-        if(debug_flag)
-        {
-            unique_ptr<ofstream> debug_info_stream = open_file_or_die<ofstream>(file_debug, ofstream::app);
+    fdatasync(desc_bin_fd);
+    close(desc_bin_fd);
+
+    if(debug_flag)
+    {
+        unique_ptr<ofstream> debug_info_stream = open_file_or_die<ofstream>(file_debug, ofstream::app);
 
-            for(size_t i = 0; i < output.size(); i++)
+        output_pos = 0;
+        for(const auto& chunk : chunks)
+        {
+            for(size_t i = chunk.first; i < chunk.second; i++, output_pos++)
             {
-                *debug_info_stream << output[i].first << " ";
+                *debug_info_stream << output.label(output_pos) << " ";
 
-                for(const string& path : (*input_list)[fork_index][i].first)
+                for(const string& path : (*input_list)[i].first)
                     *debug_info_stream << path << " ";
 
-                for(uint8_t val : output[i].second)
-                    *debug_info_stream << static_cast<int>(val) << " ";
+                const uint8_t* descriptor = output.row(output_pos);
+                for(size_t k = 0; k < output.row_size(output_pos); k++)
+                    *debug_info_stream << static_cast<int>(descriptor[k]) << " ";
 
                 *debug_info_stream << endl;
             }
         }
+    }
 
-        if(!extra_output.empty())
-        {
-            unique_ptr<ofstream> extract_info_stream = open_file_or_die<ofstream>(file_extra, ofstream::app);
+    if(!extra_output.empty())
+    {
+        unique_ptr<ofstream> extract_info_stream = open_file_or_die<ofstream>(file_extra, ofstream::app);
 
-            for(const auto& line : extra_output)
-            {
-                for(const string& path : get<0>(line))
-                    *extract_info_stream << path << " ";
+        for(const auto& line : extra_output)
+        {
+            for(const string& path : get<0>(line))
+                *extract_info_stream << path << " ";
 
-                for(const auto& eye_pair : get<1>(line))
-                    *extract_info_stream << "{" << eye_pair.isLeftAssigned << " " << eye_pair.isRightAssigned << " " << eye_pair.xleft << " " << eye_pair.yleft << " " << eye_pair.xright << " " << eye_pair.yright << "} ";
+            for(const auto& eye_pair : get<1>(line))
+                *extract_info_stream << "{" << eye_pair.isLeftAssigned << " " << eye_pair.isRightAssigned << " " << eye_pair.xleft << " " << eye_pair.yleft << " " << eye_pair.xright << " " << eye_pair.yright << "} ";
 
-                for(double val : get<2>(line))
-                    *extract_info_stream << val << " ";
+            for(double val : get<2>(line))
+                *extract_info_stream << val << " ";
 
-                *extract_info_stream << endl;
-            }
+            *extract_info_stream << endl;
         }
+    }
 
-        if(!fail_detect.empty())
-        {
-            unique_ptr<ofstream> fail_detect_stream = open_file_or_die<ofstream>(file_fail, ofstream::app);
+    if(!fail_detect.empty())
+    {
+        unique_ptr<ofstream> fail_detect_stream = open_file_or_die<ofstream>(file_fail, ofstream::app);
 
-            for(const auto& line : fail_detect)
-            {
-                for(const string& path : line)
-                    *fail_detect_stream << path << " ";
+        for(const auto& line : fail_detect)
+        {
+            for(const string& path : line)
+                *fail_detect_stream << path << " ";
 
-                *fail_detect_stream << endl;
-            }
+            *fail_detect_stream << endl;
         }
     }
 }
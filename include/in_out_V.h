@@ -8,12 +8,11 @@
 using namespace std;
 
 /*!
- * \brief Read input for match and create shared_ptr to in_out_desc_type.
+ * \brief Map the descriptor file for match.
  *
  * \param file The file path containing the input data.
- * \param desc_size The descriptor size.
- * \param counters_file The file path to the counters data (not used in this function).
+ * \param counters_file The file path to write the count of descriptors and refusals, empty for none.
  *
- * \return A shared_ptr to in_out_desc_type containing the read input data.
+ * \return A shared_ptr to the desc_set viewing the mapped file.
  */
-shared_ptr<in_out_desc_type> read_input_match(const string& file, uint desc_size, const string& counters_file = "");
+shared_ptr<const desc_set> read_input_match(const string& file, const string& counters_file = "");
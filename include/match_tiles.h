@@ -0,0 +1,71 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+#include <cstddef>
+
+#include "desc_set.h"
+
+using namespace std;
+
+/*!
+ * \brief Range of rows of the match triangle handed out to a match thread at once.
+ *
+ * Row i holds the pairs (i, j) for j > i. Within a tile the pairs are matched in square blocks of rows and
+ * columns, see plan_match_block(). Every row writes its scores to its own place in the output, see
+ * match_row_begin(), so tiles and blocks matched in any order fill the output exactly as a serial run does.
+ */
+struct match_tile
+{
+    size_t row_begin;
+    size_t row_end;
+};
+
+/*!
+ * \brief Split the match triangle of a descriptor set into tiles with about the same count of pairs.
+ *
+ * \param descriptors The descriptor set, all labels must be non-zero.
+ * \param count_tiles The desired count of tiles, fewer are made if there are not enough rows.
+ * \param row_true_begin Reference to store the position of the first same-label score of each row among the true matches,
+ *                       one more element than descriptors, the last one is the count of true matches.
+ *
+ * \return The tiles in row order.
+ */
+vector<match_tile> plan_match_tiles(const desc_set& descriptors, size_t count_tiles, vector<size_t>& row_true_begin);
+
+/*!
+ * \brief Get the position of the first pair of a row in the serial order of the match triangle.
+ *
+ * \param count_desc The count of descriptors.
+ * \param row The row index, up to count_desc.
+ *
+ * \return The count of pairs in the rows before.
+ */
+inline size_t match_row_begin(size_t count_desc, size_t row)
+{
+    return row * count_desc - row * (row + 1) / 2;
+}
+
+/*!
+ * \brief Get the size of a data cache of the first CPU as reported by sysfs.
+ *
+ * \param level The cache level.
+ *
+ * \return The cache size in bytes, 0 if it is unknown.
+ */
+size_t read_cache_size(uint level);
+
+/*!
+ * \brief Choose the count of descriptors per block of the blocked match traversal.
+ *
+ * A block of columns is matched against a block of rows before moving on, so the column block is read
+ * from memory once per row block instead of once per row. The block is sized to fill half of the cache
+ * with column descriptors, the rest is left to the row descriptors and the matcher.
+ *
+ * \param descriptors The descriptor set.
+ * \param cache_size The cache size in bytes, 0 if it is unknown.
+ *
+ * \return The count of descriptors per block.
+ */
+size_t plan_match_block(const desc_set& descriptors, size_t cache_size);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ * \brief Pixel layout of the bitmaps passed to the engine.
+ */
+enum class bitmap_layout
+{
+    rgb,
+    bgr,
+    gray
+};
+
+/*!
+ * \brief Get the count of bytes per pixel of a layout.
+ *
+ * \param layout The layout.
+ *
+ * \return 1 for grayscale, 3 for color layouts.
+ */
+size_t bitmap_layout_channels(bitmap_layout layout);
+
+/*!
+ * \brief Get the name of a layout.
+ *
+ * \param layout The layout.
+ *
+ * \return "rgb", "bgr" or "gray".
+ */
+const char* bitmap_layout_name(bitmap_layout layout);
+
+/*!
+ * \brief Get a layout by its name.
+ *
+ * \param name The name: "rgb" or "bgr".
+ *
+ * \return The color layout.
+ *
+ * \throws logic_error if the name is unknown.
+ */
+bitmap_layout bitmap_layout_from_name(const string& name);
+
+/*!
+ * \brief Convert a row of 24 or 32-bit pixels to 8-bit grayscale.
+ *
+ * Gray is 0.2126 R + 0.7152 G + 0.0722 B rounded, computed in single precision in the same order as
+ * FreeImage_ConvertToGreyscale(), so the vectorized kernels give the same bytes as FreeImage.
+ *
+ * \param src The source row.
+ * \param dst The destination row of width bytes.
+ * \param width The count of pixels.
+ * \param pixel_step The count of bytes per source pixel, 3 or 4.
+ * \param red_first Flag to indicate whether red is the first byte of a source pixel, otherwise blue is.
+ */
+void convert_row_to_gray(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool red_first);
+
+/*!
+ * \brief Copy a row of 24 or 32-bit pixels to 24-bit pixels, swapping red and blue if requested.
+ *
+ * \param src The source row.
+ * \param dst The destination row of 3 * width bytes.
+ * \param width The count of pixels.
+ * \param pixel_step The count of bytes per source pixel, 3 or 4.
+ * \param swap_red_blue Flag to indicate whether to swap the first and the third byte of each pixel.
+ */
+void convert_row_to_color(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool swap_red_blue);
+
+/*!
+ * \brief Get the instruction set of the conversion kernels selected for this CPU.
+ *
+ * \return "avx2", "ssse3" or "scalar".
+ */
+const char* pixel_convert_isa();
+
+/*!
+ * \brief Check the conversion kernels selected for this CPU against the scalar kernels.
+ *
+ * Rows of 1 to 80 pixels at unaligned offsets are converted with every pixel step and channel order,
+ * the kernels must give the same bytes.
+ *
+ * \throws logic_error on the first row the kernels differ.
+ */
+void pixel_convert_self_check();
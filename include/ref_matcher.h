@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "desc_set.h"
+
+using namespace std;
+
+/*!
+ * \brief Type of the elements of a descriptor vector.
+ */
+enum class ref_element
+{
+    float32,
+    float16,
+    int8
+};
+
+/*!
+ * \brief Similarity of two descriptor vectors.
+ *
+ * dot - the dot product, cosine - the cosine of the angle, l2 - 1 / (1 + the Euclidean distance),
+ * so a greater similarity means closer vectors for all of them.
+ */
+enum class ref_metric
+{
+    dot,
+    cosine,
+    l2
+};
+
+/*!
+ * \brief Get the name of an element type.
+ *
+ * \param element The element type.
+ *
+ * \return "float32", "float16" or "int8".
+ */
+const char* ref_element_name(ref_element element);
+
+/*!
+ * \brief Get the name of a metric.
+ *
+ * \param metric The metric.
+ *
+ * \return "dot", "cosine" or "l2".
+ */
+const char* ref_metric_name(ref_metric metric);
+
+/*!
+ * \brief Get the size of an element type.
+ *
+ * \param element The element type.
+ *
+ * \return The size of one element in bytes.
+ */
+size_t ref_element_size(ref_element element);
+
+/*!
+ * \brief Matcher of the descriptors of a descriptor set that are plain vectors, computed by the harness.
+ *
+ * The descriptors are compared by kernels selected once for the CPU the harness runs on, see ref_matcher_isa().
+ * It serves engines that declare their template layout instead of matching the templates themselves, and as
+ * the speed-of-light baseline of the match stage for engines that do.
+ */
+class ref_matcher
+{
+
+public:
+    /*!
+     * \brief Create a matcher of a descriptor set, checking the size of its templates.
+     *
+     * \param descriptors The descriptor set, it must outlive the matcher.
+     * \param element The element type of the vectors.
+     * \param metric The metric to compare the vectors with.
+     * \param offset The offset of the vector from the beginning of a template in bytes.
+     * \param dimension The count of elements of the vector.
+     */
+    ref_matcher(const desc_set& descriptors, ref_element element, ref_metric metric, size_t offset, size_t dimension);
+
+    ref_matcher(const ref_matcher&) = delete;
+    ref_matcher& operator=(const ref_matcher&) = delete;
+
+    /*!
+     * \brief Match a descriptor against several descriptors of the set.
+     *
+     * \param row The index of the descriptor.
+     * \param columns The indexes of the descriptors to compare it with.
+     * \param similarities Reference to store the similarity to each of columns.
+     */
+    void match_batch(size_t row, const vector<size_t>& columns, vector<double>& similarities) const;
+
+    /*!
+     * \brief Get the template size the layout needs.
+     *
+     * \return The offset plus the size of the vector in bytes.
+     */
+    size_t template_size() const;
+
+private:
+    typedef float (*kernel_function)(const uint8_t* a, const uint8_t* b, size_t dimension);
+
+    const desc_set& m_descriptors;
+    ref_metric m_metric;
+    size_t m_offset;
+    size_t m_dimension;
+    size_t m_template_size;
+    kernel_function m_kernel;
+
+    // 1 / norm of each descriptor for the cosine metric, so a pair costs a single dot product
+    vector<float> m_inv_norms;
+};
+
+/*!
+ * \brief Get the instruction set of the match kernels selected for this CPU.
+ *
+ * \return "avx512", "avx2" or "scalar".
+ */
+const char* ref_matcher_isa();
+
+/*!
+ * \brief Check the match kernels selected for this CPU against the scalar kernels.
+ *
+ * Every element type and kernel is run for dimensions 1 to 513 at offsets 0, 1 and 3, with int8 extremes
+ * and with each of the 65536 float16 values, the kernels must agree up to the float rounding of the sums.
+ *
+ * \throws logic_error on the first case the kernels differ.
+ */
+void ref_matcher_self_check();
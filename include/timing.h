@@ -35,6 +35,7 @@ public:
     timing(bool extended = false);
     void start();
     nanoseconds stop();
+    void merge(const timing& other);
     nanoseconds get_average();
     extended_info_type<nanoseconds> get_extended_info(float percentile);
 
@@ -2,6 +2,8 @@
 
 #include <unordered_map>
 #include <memory>
+#include <thread>
+#include <exception>
 #include <numeric>
 #include <cmath>
 
@@ -9,6 +11,8 @@
 #include <glog/logging.h>
 
 #include "timing.h"
+#include "bitmap_pool.h"
+#include "pixel_convert.h"
 
 #define Q(str) #str
 #define QUOTES(str) Q(str)
@@ -38,6 +42,16 @@ template<typename T_stream_type, typename ...Args>
  */
 unique_ptr<T_stream_type> open_file_or_die(const string& file, const Args&... args);
 
+/*!
+ * \brief Converts a relative file path to an absolute file path based on the 'split' parameter.
+ *
+ * \param original The relative file path that needs to be converted to an absolute path.
+ * \param params The dictionary containing parameters, including the 'split' parameter used as the base directory.
+ *
+ * \return The absolute file path as a string.
+ */
+string relative_to_abs(const string& original, params_type& params);
+
 /*!
  * \brief Get the absolute file path from a parameter value using a map of parameters.
  *
@@ -48,23 +62,84 @@ unique_ptr<T_stream_type> open_file_or_die(const string& file, const Args&... ar
  */
 string get_abs(shared_ptr<TCLAP::Arg> arg, params_type& params);
 
+/*!
+ * \brief Time spent by get_bitmap() in each stage of loading images.
+ */
+struct bitmap_timings
+{
+    nanoseconds read{0};
+    nanoseconds decode{0};
+    nanoseconds convert{0};
+};
+
 /*!
  * \brief Load and extract bitmap data from an image file.
  *
  * \param file The file path of the image to load.
- * \param gray_flag Flag to indicate whether to convert the image to grayscale.
+ * \param layout The pixel layout of the bitmap: RGB, BGR or grayscale.
  * \param width Reference to store the width of the loaded bitmap.
  * \param height Reference to store the height of the loaded bitmap.
+ * \param max_width The width the engine makes use of, JPEG images are decoded at a reduced scale down to it (0 - no limit).
+ * \param max_height The height the engine makes use of, JPEG images are decoded at a reduced scale down to it (0 - no limit).
+ * \param pool The pool to take the bitmap buffer from, nullptr to allocate it.
+ * \param timings The timings to add the time of the read, decode and convert stages to, nullptr to skip timing.
  *
- * \return A shared_ptr to the loaded bitmap data as an array of uint8_t.
+ * \return A shared_ptr to the loaded bitmap data as an array of uint8_t, rows top-down without padding.
  */
-shared_ptr<uint8_t> get_bitmap(const string& file, bool gray_flag, size_t& width, size_t& height);
+shared_ptr<uint8_t> get_bitmap(const string& file, bitmap_layout layout, size_t& width, size_t& height, size_t max_width = 0, size_t max_height = 0, bitmap_pool* pool = nullptr, bitmap_timings* timings = nullptr);
 
 /*!
  * \brief Wait for all child processes to complete and check for errors.
  */
 void wait_all_forks();
 
+/*!
+ * \brief Join all worker threads and check for errors.
+ *
+ * \param workers The worker threads to join.
+ * \param errors The exceptions captured by the workers, indexed by worker index (empty if the worker succeeded).
+ * \param stage The name of the stage the workers run, used in the error message.
+ */
+void wait_all_threads(vector<thread>& workers, const vector<exception_ptr>& errors, const string& stage = "extract");
+
+/*!
+ * \brief Check the extract mode parameter value.
+ *
+ * \param mode The extract mode: "fork" or "threads".
+ *
+ * \return 'true' if extract workers should run as threads in one process, 'false' if they should be forked.
+ *
+ * \throws logic_error if the extract mode is unknown.
+ */
+bool extract_mode_is_threads(const string& mode);
+
+/*!
+ * \brief Read files once so later reads are served from the page cache.
+ *
+ * \param files The file paths, missing files are skipped.
+ */
+void read_to_page_cache(const vector<string>& files);
+
+/*!
+ * \brief Read the dimensions of images from their headers, without decoding the pixels.
+ *
+ * \param files The file paths of the images.
+ * \param count_threads The count of threads reading the headers.
+ *
+ * \return The count of pixels of each image, 0 for images whose header can not be read.
+ */
+vector<uint64_t> read_image_pixels(const vector<string>& files, uint count_threads);
+
+/*!
+ * \brief Log the throughput, speedup and parallel efficiency of a scaling sweep and choose the worker count.
+ *
+ * \param counts The worker counts of the sweep, the first one is the base of the speedup.
+ * \param throughputs The throughput of each worker count in templates per second.
+ *
+ * \return The smallest worker count within 5% of the best throughput.
+ */
+uint log_scaling_sweep(const vector<uint>& counts, const vector<double>& throughputs);
+
 template<typename T_time>
 /*!
  * \brief Log extended timing information with optional fork index.
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ * \brief CPUs and NUMA node assigned to one extract worker.
+ *
+ * cpus run the thread calling createTemplate, node_cpus, all allowed CPUs of the node, run the decode threads.
+ */
+struct worker_placement
+{
+    vector<int> cpus;
+    int node;
+    vector<int> node_cpus;
+};
+
+/*!
+ * \brief Plan the placement of the extract workers over the CPUs the process is allowed to run on.
+ *
+ * Mode "cpu" pins each worker to one CPU, taking the CPUs of the NUMA nodes in turn, so the workers
+ * spread over all sockets. Mode "node" pins each worker to all CPUs of one NUMA node, nodes in turn.
+ * Mode "none" leaves the workers to the OS scheduler and returns an empty plan.
+ *
+ * \param mode The pinning mode: none, cpu or node.
+ * \param count_workers The count of extract workers.
+ *
+ * \return The placement of each worker, empty for mode "none".
+ */
+vector<worker_placement> plan_worker_placement(const string& mode, size_t count_workers);
+
+/*!
+ * \brief Pin the calling thread to the placement of an extract worker for the lifetime of the object.
+ *
+ * The calling thread is first pinned to the CPUs of the NUMA node of the worker, so threads it creates,
+ * e.g. decode threads, inherit the node and not a single CPU. pin_worker_cpus() then narrows the calling
+ * thread alone to the CPUs of the worker. The previous CPU affinity and memory policy of the thread are
+ * restored on destruction, so worker 0 running in the main process does not leave it pinned.
+ */
+class scoped_worker_placement
+{
+
+public:
+    /*!
+     * \brief Apply the placement to the calling thread.
+     *
+     * \param placement The placement of the worker.
+     * \param bind_memory Flag to indicate whether to bind memory allocations to the NUMA node of the worker.
+     * \param fork_index The index of the extract worker.
+     */
+    scoped_worker_placement(const worker_placement& placement, bool bind_memory, size_t fork_index);
+    ~scoped_worker_placement();
+
+    /*!
+     * \brief Pin the calling thread to the CPUs of the worker, call it once the decode threads are started.
+     */
+    void pin_worker_cpus();
+
+    scoped_worker_placement(const scoped_worker_placement&) = delete;
+    scoped_worker_placement& operator=(const scoped_worker_placement&) = delete;
+
+private:
+    worker_placement m_placement;
+    size_t m_fork_index;
+    cpu_set_t m_saved_cpus;
+    bool m_memory_bound;
+};
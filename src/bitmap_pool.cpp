@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "bitmap_pool.h"
+
+/*!
+ * \brief Create an empty pool.
+ *
+ * \param max_free_buffers The count of returned buffers the pool keeps for reuse.
+ */
+bitmap_pool::bitmap_pool(size_t max_free_buffers) : m_state(make_shared<pool_state>())
+{
+    m_state->max_free_buffers = max_free_buffers;
+}
+
+/*!
+ * \brief Take a buffer of at least the given size.
+ *
+ * \param size The size of the buffer in bytes.
+ *
+ * \return A shared_ptr to the buffer, it returns to the pool on release.
+ */
+shared_ptr<uint8_t> bitmap_pool::get(size_t size)
+{
+    buffer_type buffer{0, nullptr};
+    {
+        lock_guard<mutex> lock(m_state->pool_mutex);
+
+        auto& free_buffers = m_state->free_buffers;
+
+        auto best_fit = free_buffers.end();
+        for(auto it = free_buffers.begin(); it != free_buffers.end(); ++it)
+            if(it->capacity >= size && (best_fit == free_buffers.end() || it->capacity < best_fit->capacity))
+                best_fit = it;
+
+        if(best_fit != free_buffers.end())
+        {
+            buffer = move(*best_fit);
+            free_buffers.erase(best_fit);
+        }
+    }
+
+    if(!buffer.data)
+        buffer = {size, unique_ptr<uint8_t[]>(new uint8_t[size])};
+
+    const size_t capacity = buffer.capacity;
+    shared_ptr<pool_state> state = m_state;
+
+    return shared_ptr<uint8_t>(buffer.data.release(), [state, capacity](uint8_t* data)
+    {
+        unique_ptr<uint8_t[]> released(data);
+
+        lock_guard<mutex> lock(state->pool_mutex);
+
+        auto& free_buffers = state->free_buffers;
+
+        if(free_buffers.size() >= state->max_free_buffers)
+        {
+            auto smallest = min_element(free_buffers.begin(), free_buffers.end(), [](const buffer_type& a, const buffer_type& b) { return a.capacity < b.capacity; });
+
+            if(smallest == free_buffers.end() || smallest->capacity >= capacity)
+                return;
+
+            free_buffers.erase(smallest);
+        }
+
+        free_buffers.push_back({capacity, move(released)});
+    });
+}
@@ -0,0 +1,408 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "in_out.h"
+#include "desc_file.h"
+
+static const char desc_magic[8] = {'F', 'M', 'D', 'E', 'S', 'C', '\0', '\0'};
+static const uint32_t desc_version = 2;
+static const size_t desc_alignment = 64;
+
+/*!
+ * \brief Map a whole file.
+ *
+ * \param file The file path.
+ * \param writable Flag to indicate whether to map the file for writing, shared with the file, otherwise read-only.
+ * \param map_size Reference to store the size of the mapping.
+ *
+ * \return A shared_ptr to the mapping, unmapped when the last copy is released.
+ */
+static shared_ptr<uint8_t> map_file(const string& file, bool writable, size_t& map_size)
+{
+    int fd = open(file.c_str(), writable ? O_RDWR : O_RDONLY);
+
+    if(fd < 0)
+        throw runtime_error("failed to open " + file);
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat))
+    {
+        close(fd);
+        throw runtime_error("failed to open " + file);
+    }
+
+    map_size = static_cast<size_t>(file_stat.st_size);
+
+    if(map_size < sizeof(uint64_t))
+    {
+        close(fd);
+        throw runtime_error("descriptors file " + file + " is too short");
+    }
+
+    void* map_base = mmap(nullptr, map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map_base == MAP_FAILED)
+        throw runtime_error("failed to map " + file);
+
+    const size_t unmap_size = map_size;
+    return shared_ptr<uint8_t>(static_cast<uint8_t*>(map_base), [unmap_size](uint8_t* base) { munmap(base, unmap_size); });
+}
+
+/*!
+ * \brief Continue an FNV-1a hash over 64-bit words of a buffer, the tail is hashed byte by byte.
+ *
+ * \param data The buffer.
+ * \param size The size of the buffer in bytes.
+ * \param hash The hash of the preceding data.
+ *
+ * \return The hash including the buffer.
+ */
+static uint64_t hash_words(const uint8_t* data, size_t size, uint64_t hash)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+    }
+
+    for(; i < size; i++)
+        hash = (hash ^ data[i]) * prime;
+
+    return hash;
+}
+
+/*!
+ * \brief Map a finalized descriptor file and check its header and offset table.
+ *
+ * \param file The file path of the descriptors.
+ * \param verify_flag Flag to indicate whether to check the labels, offsets and descriptors against the checksum.
+ */
+desc_file::desc_file(const string& file, bool verify_flag)
+{
+    size_t map_size = 0;
+    m_mapping = map_file(file, false, map_size);
+
+    if(map_size < sizeof(file_header))
+        throw runtime_error("descriptors file " + file + " is too short");
+
+    memcpy(&m_header, m_mapping.get(), sizeof(file_header));
+    check_header(m_header, map_size, file);
+
+    if(m_header.state != state_packed)
+        throw runtime_error("descriptors file " + file + " is not finalized, the extract stage did not finish");
+
+    // rows are located through the table, so it is checked even without the checksum to keep them inside the mapping
+    const uint64_t* table = reinterpret_cast<const uint64_t*>(m_mapping.get() + table_offset(m_header.count, 0));
+
+    bool table_flag = table[0] == 0 && table[m_header.count] == m_header.descriptors_size;
+    for(size_t i = 0; table_flag && i < m_header.count; i++)
+        table_flag = table[i] <= table[i + 1] && table[i + 1] - table[i] <= m_header.desc_size;
+
+    if(!table_flag)
+        throw runtime_error("descriptors file " + file + " has a wrong offset table");
+
+    if(verify_flag && checksum(m_mapping.get(), m_header) != m_header.checksum)
+        throw runtime_error("descriptors file " + file + " does not match its checksum, the file is damaged");
+}
+
+/*!
+ * \brief Get the count of descriptors.
+ *
+ * \return The count of descriptors, refusals included.
+ */
+size_t desc_file::size() const
+{
+    return m_header.count;
+}
+
+/*!
+ * \brief Get the maximum size of one descriptor.
+ *
+ * \return The maximum descriptor size in bytes the file was extracted with.
+ */
+size_t desc_file::desc_size() const
+{
+    return m_header.desc_size;
+}
+
+/*!
+ * \brief Get the size of all descriptors.
+ *
+ * \return The size of the descriptor block in bytes.
+ */
+size_t desc_file::descriptors_size() const
+{
+    return m_header.descriptors_size;
+}
+
+/*!
+ * \brief Get the count of refused templates.
+ *
+ * \return The count of descriptors with a negative label.
+ */
+size_t desc_file::refusal_count() const
+{
+    return m_header.refusal_count;
+}
+
+/*!
+ * \brief Get the labels and descriptors as a descriptor set.
+ *
+ * \return A read-only desc_set viewing the mapping, which it keeps alive.
+ */
+desc_set desc_file::descriptors() const
+{
+    return desc_set(m_header.count, reinterpret_cast<const int*>(m_mapping.get() + label_offset(0)),
+                    reinterpret_cast<const uint64_t*>(m_mapping.get() + table_offset(m_header.count, 0)), m_mapping.get() + m_header.descriptors_offset, m_mapping);
+}
+
+/*!
+ * \brief Create a descriptor file with its final size and header, so extract workers can write to their offsets without locking.
+ *
+ * \param file The file path of the descriptors.
+ * \param count The count of templates in the extract list.
+ * \param desc_size The maximum descriptor size.
+ */
+void desc_file::create(const string& file, size_t count, uint desc_size)
+{
+    const file_header header = make_header(count, desc_size);
+
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(fd < 0)
+        throw runtime_error("failed to open " + file);
+
+    int err = posix_fallocate(fd, 0, static_cast<off_t>(descriptor_offset(count, desc_size, count)));
+
+    if(err)
+    {
+        close(fd);
+        throw runtime_error("failed to preallocate " + file + ": " + strerror(err));
+    }
+
+    try
+    {
+        pwrite_or_die(fd, &header, sizeof(file_header), 0, file);
+    }
+    catch(...)
+    {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+}
+
+/*!
+ * \brief Check that an existing descriptor file was created for the same count and maximum descriptor size.
+ *
+ * \param file The file path of the descriptors.
+ * \param count The count of templates in the extract list.
+ * \param desc_size The maximum descriptor size.
+ *
+ * \return 'true' if the file is already finalized, no more templates can be written to it.
+ */
+bool desc_file::check(const string& file, size_t count, uint desc_size)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+
+    if(fd < 0)
+        throw runtime_error("failed to open " + file);
+
+    struct stat file_stat;
+    file_header header;
+    const bool read_flag = !fstat(fd, &file_stat) && pread(fd, &header, sizeof(file_header), 0) == sizeof(file_header);
+    close(fd);
+
+    if(!read_flag)
+        throw runtime_error("failed to read the header of " + file);
+
+    check_header(header, static_cast<size_t>(file_stat.st_size), file);
+
+    if(header.count != count || header.desc_size != desc_size)
+        throw runtime_error("descriptors file " + file + " holds " + to_string(header.count) + " descriptors of up to " + to_string(header.desc_size)
+                            + " bytes, expected " + to_string(count) + " of up to " + to_string(desc_size) + " bytes");
+
+    if(header.state == state_packing)
+        throw runtime_error("descriptors file " + file + " was interrupted while finalizing, extract it again");
+
+    return header.state == state_packed;
+}
+
+/*!
+ * \brief Pack the descriptors of a written descriptor file, count the refusals, compute the checksum and store them in its header.
+ *
+ * \param file The file path of the descriptors.
+ * \param labels Pointer to a vector to store a copy of the labels while they are at hand, nullptr for none.
+ * \param offsets Pointer to a vector to store the offsets of the descriptors from the beginning of the file, count + 1 elements, nullptr for none.
+ */
+void desc_file::finalize(const string& file, vector<int>* labels, vector<uint64_t>* offsets)
+{
+    file_header header;
+    {
+        size_t map_size = 0;
+        shared_ptr<uint8_t> mapping = map_file(file, true, map_size);
+
+        if(map_size < sizeof(file_header))
+            throw runtime_error("descriptors file " + file + " is too short");
+
+        memcpy(&header, mapping.get(), sizeof(file_header));
+        check_header(header, map_size, file);
+
+        if(header.state == state_packing)
+            throw runtime_error("descriptors file " + file + " was interrupted while finalizing, extract it again");
+
+        const int* file_labels = reinterpret_cast<const int*>(mapping.get() + label_offset(0));
+        uint64_t* table = reinterpret_cast<uint64_t*>(mapping.get() + table_offset(header.count, 0));
+
+        if(header.state == state_slots)
+        {
+            // the packing state reaches the disk before any slot moves, so an interrupted packing is detected instead of resumed
+            header.state = state_packing;
+            memcpy(mapping.get(), &header, sizeof(file_header));
+            if(msync(mapping.get(), sizeof(file_header), MS_SYNC))
+                throw runtime_error("failed to sync " + file);
+
+            // descriptors are packed front to back, none moves past the beginning of its own slot
+            uint8_t* data = mapping.get() + header.descriptors_offset;
+            uint64_t end = 0;
+            for(size_t i = 0; i < header.count; i++)
+            {
+                const uint64_t size = table[i];
+
+                if(size > header.desc_size)
+                    throw runtime_error("descriptors file " + file + " has a descriptor of " + to_string(size) + " bytes, more than " + to_string(header.desc_size));
+
+                if(size && end != i * header.desc_size)
+                    memmove(data + end, data + i * header.desc_size, size);
+
+                table[i] = end;
+                end += size;
+            }
+
+            table[header.count] = end;
+            header.descriptors_size = end;
+            header.state = state_packed;
+        }
+
+        header.refusal_count = 0;
+        for(size_t i = 0; i < header.count; i++)
+            if(file_labels[i] < 0)
+                header.refusal_count++;
+
+        if(labels)
+            labels->assign(file_labels, file_labels + header.count);
+
+        if(offsets)
+        {
+            offsets->resize(header.count + 1);
+            for(size_t i = 0; i <= header.count; i++)
+                (*offsets)[i] = header.descriptors_offset + table[i];
+        }
+
+        header.checksum = checksum(mapping.get(), header);
+        memcpy(mapping.get(), &header, sizeof(file_header));
+
+        if(msync(mapping.get(), map_size, MS_SYNC))
+            throw runtime_error("failed to sync " + file);
+    }
+
+    if(truncate(file.c_str(), static_cast<off_t>(header.descriptors_offset + header.descriptors_size)))
+        throw runtime_error("failed to truncate " + file);
+}
+
+/*!
+ * \brief Get the offset of a label in a descriptor file.
+ *
+ * \param index The index of the template.
+ *
+ * \return The offset in bytes from the beginning of the file.
+ */
+size_t desc_file::label_offset(size_t index)
+{
+    return sizeof(file_header) + index * sizeof(int);
+}
+
+/*!
+ * \brief Get the offset of an entry of the offset table in a descriptor file.
+ *
+ * \param count The count of templates in the file.
+ * \param index The index of the template.
+ *
+ * \return The offset in bytes from the beginning of the file.
+ */
+size_t desc_file::table_offset(size_t count, size_t index)
+{
+    const size_t labels_end = label_offset(count);
+
+    return (labels_end + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t) + index * sizeof(uint64_t);
+}
+
+/*!
+ * \brief Get the offset of the slot of a descriptor in a descriptor file that is not finalized yet.
+ *
+ * \param count The count of templates in the file.
+ * \param desc_size The maximum descriptor size.
+ * \param index The index of the template.
+ *
+ * \return The offset in bytes from the beginning of the file.
+ */
+size_t desc_file::descriptor_offset(size_t count, size_t desc_size, size_t index)
+{
+    const size_t table_end = table_offset(count, count + 1);
+
+    return (table_end + desc_alignment - 1) / desc_alignment * desc_alignment + index * desc_size;
+}
+
+desc_file::file_header desc_file::make_header(size_t count, uint desc_size)
+{
+    file_header header;
+    memset(&header, 0, sizeof(file_header));
+
+    memcpy(header.magic, desc_magic, sizeof(desc_magic));
+    header.version = desc_version;
+    header.desc_size = desc_size;
+    header.count = count;
+    header.descriptors_offset = descriptor_offset(count, desc_size, 0);
+    header.state = state_slots;
+
+    return header;
+}
+
+void desc_file::check_header(const file_header& header, size_t file_size, const string& file)
+{
+    if(memcmp(header.magic, desc_magic, sizeof(desc_magic)))
+        throw runtime_error(file + " is not a descriptors file, extract it again");
+
+    if(header.version != desc_version)
+        throw runtime_error("descriptors file " + file + " has version " + to_string(header.version) + ", expected " + to_string(desc_version) + ", extract it again");
+
+    if(header.state > state_packed || header.count > file_size / sizeof(int) || header.descriptors_offset != descriptor_offset(header.count, header.desc_size, 0)
+            || file_size < header.descriptors_offset)
+        throw runtime_error("descriptors file " + file + " has a wrong header");
+
+    const size_t block_size = file_size - header.descriptors_offset;
+    const bool block_flag = header.state == state_packed ? header.descriptors_size <= block_size
+                                                         : !header.desc_size || header.count <= block_size / header.desc_size;
+
+    if(!block_flag)
+        throw runtime_error("descriptors file " + file + " is too short");
+}
+
+uint64_t desc_file::checksum(const uint8_t* base, const file_header& header)
+{
+    uint64_t hash = hash_words(base + label_offset(0), header.count * sizeof(int), 0xcbf29ce484222325ULL);
+    hash = hash_words(base + table_offset(header.count, 0), (header.count + 1) * sizeof(uint64_t), hash);
+
+    return hash_words(base + header.descriptors_offset, header.descriptors_size, hash);
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "desc_set.h"
+
+static const size_t desc_set_alignment = 64;
+
+/*!
+ * \brief Create an empty set that owns its buffers.
+ *
+ * \param slot_size The maximum descriptor size.
+ */
+desc_set::desc_set(size_t slot_size) : m_slot_size(slot_size), m_count(0), m_capacity(0), m_labels(nullptr), m_offsets(nullptr), m_data(nullptr)
+{
+}
+
+/*!
+ * \brief Create a read-only view of labels and descriptors owned elsewhere.
+ *
+ * \param count The count of descriptors.
+ * \param labels The labels, count elements.
+ * \param offsets The offsets of the descriptors from data, count + 1 elements, the last one is the end of the last descriptor.
+ * \param data The descriptors.
+ * \param owner The object owning the labels, the offsets and the descriptors, kept alive while the view exists.
+ */
+desc_set::desc_set(size_t count, const int* labels, const uint64_t* offsets, const uint8_t* data, shared_ptr<const void> owner)
+    : m_slot_size(0), m_count(count), m_capacity(0), m_labels(labels), m_offsets(offsets), m_data(data), m_owner(owner)
+{
+}
+
+/*!
+ * \brief Append a descriptor to a set that owns its buffers.
+ *
+ * \param label The label of the descriptor.
+ * \param descriptor The descriptor.
+ * \param size The descriptor size, at most slot_size().
+ */
+void desc_set::push_back(int label, const uint8_t* descriptor, size_t size)
+{
+    if(m_owner)
+        throw logic_error("can not append to a read-only descriptor set");
+
+    if(size > m_slot_size)
+        throw logic_error("descriptor size " + to_string(size) + " is greater than the slot size " + to_string(m_slot_size));
+
+    if(m_count == m_capacity)
+        reserve(max<size_t>(16, 2 * m_capacity));
+
+    uint8_t* slot = m_own_data.get() + m_count * m_slot_size;
+    if(size)
+        memcpy(slot, descriptor, size);
+    memset(slot + size, 0, m_slot_size - size);
+
+    m_own_labels[m_count] = label;
+    m_own_sizes[m_count] = size;
+    m_count++;
+}
+
+/*!
+ * \brief Remove all descriptors of a set that owns its buffers, the capacity is kept.
+ */
+void desc_set::clear()
+{
+    if(m_owner)
+        throw logic_error("can not clear a read-only descriptor set");
+
+    m_count = 0;
+}
+
+void desc_set::reserve(size_t capacity)
+{
+    void* buf = nullptr;
+    if(posix_memalign(&buf, desc_set_alignment, max<size_t>(1, capacity * m_slot_size)))
+        throw bad_alloc();
+
+    shared_ptr<uint8_t> data(static_cast<uint8_t*>(buf), free);
+    if(m_count)
+        memcpy(data.get(), m_own_data.get(), m_count * m_slot_size);
+
+    m_own_data = data;
+    m_own_labels.resize(capacity);
+    m_own_sizes.resize(capacity);
+    m_capacity = capacity;
+
+    m_labels = m_own_labels.data();
+    m_data = m_own_data.get();
+}
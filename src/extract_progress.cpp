@@ -0,0 +1,146 @@
+#include <sys/mman.h>
+
+#include <new>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "utils.h"
+#include "extract_progress.h"
+
+static const char* stage_names[] = {"read", "decode", "convert", "createTemplate", "write"};
+
+/*!
+ * \brief Create the shared counters.
+ *
+ * \param count_templates The count of templates the extract stage has to process.
+ * \param report_interval The interval of the periodic reports (0 - no periodic reports).
+ */
+extract_progress::extract_progress(size_t count_templates, seconds report_interval)
+    : m_count_templates(count_templates), m_report_interval_ns(duration_cast<nanoseconds>(report_interval).count()), m_tstart(steady_clock::now())
+{
+    void* shared = mmap(nullptr, sizeof(shared_counters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(shared == MAP_FAILED)
+        throw runtime_error("failed to map extract progress counters");
+
+    m_counters = new(shared) shared_counters();
+
+    m_counters->templates = 0;
+    m_counters->images = 0;
+    for(auto& stage_ns : m_counters->stage_ns)
+        stage_ns = 0;
+    m_counters->last_report_ns = 0;
+
+    if(!m_counters->templates.is_lock_free() || !m_counters->last_report_ns.is_lock_free())
+        throw runtime_error("extract progress counters are not lock free, they can not be shared between processes");
+}
+
+extract_progress::~extract_progress()
+{
+    munmap(m_counters, sizeof(shared_counters));
+}
+
+/*!
+ * \brief Get the time since the start of the extract stage, the monotonic clock is shared by the forked workers.
+ *
+ * \return The time in nanoseconds.
+ */
+int64_t extract_progress::elapsed_ns() const
+{
+    return duration_cast<nanoseconds>(steady_clock::now() - m_tstart).count();
+}
+
+/*!
+ * \brief Add time spent in a stage.
+ *
+ * \param stage The stage.
+ * \param interval The time spent.
+ */
+void extract_progress::add_time(extract_stage stage, nanoseconds interval)
+{
+    m_counters->stage_ns[static_cast<size_t>(stage)].fetch_add(static_cast<uint64_t>(interval.count()), memory_order_relaxed);
+}
+
+/*!
+ * \brief Add the timings of loaded images.
+ *
+ * \param timings The time spent in the read, decode and convert stages.
+ * \param count_images The count of loaded images.
+ */
+void extract_progress::add_images(const bitmap_timings& timings, size_t count_images)
+{
+    add_time(extract_stage::read, timings.read);
+    add_time(extract_stage::decode, timings.decode);
+    add_time(extract_stage::convert, timings.convert);
+
+    m_counters->images.fetch_add(count_images, memory_order_relaxed);
+}
+
+/*!
+ * \brief Count processed templates and print the periodic report if it is due.
+ *
+ * \param count_templates The count of templates processed since the last call.
+ */
+void extract_progress::add_templates(size_t count_templates)
+{
+    const uint64_t templates = m_counters->templates.fetch_add(count_templates, memory_order_relaxed) + count_templates;
+
+    if(!m_report_interval_ns)
+        return;
+
+    const int64_t now_ns = elapsed_ns();
+    int64_t last_report_ns = m_counters->last_report_ns.load(memory_order_relaxed);
+
+    if(now_ns - last_report_ns < m_report_interval_ns || !m_counters->last_report_ns.compare_exchange_strong(last_report_ns, now_ns))
+        return;
+
+    const double elapsed = now_ns / 1e9;
+    const double templates_rate = templates / elapsed;
+    const double images_rate = m_counters->images.load(memory_order_relaxed) / elapsed;
+    const double eta = templates_rate > 0 ? (m_count_templates - min<uint64_t>(templates, m_count_templates)) / templates_rate : 0;
+
+    LOG(INFO) << "progress: " << templates << "/" << m_count_templates << " templates (" << to_string_form(100.0 * templates / max<size_t>(m_count_templates, 1), 1)
+              << "%), " << to_string_form(templates_rate, 2) << " templates/s, " << to_string_form(images_rate, 2) << " images/s, ETA "
+              << duration_to_string(duration<double, sec_t>(eta), 0);
+
+    log_stage_split();
+}
+
+/*!
+ * \brief Log the share of each stage in the time spent by all workers and decode threads.
+ */
+void extract_progress::log_stage_split() const
+{
+    uint64_t stage_ns[static_cast<size_t>(extract_stage::count)];
+    uint64_t total_ns = 0;
+    for(size_t i = 0; i < static_cast<size_t>(extract_stage::count); i++)
+    {
+        stage_ns[i] = m_counters->stage_ns[i].load(memory_order_relaxed);
+        total_ns += stage_ns[i];
+    }
+
+    const uint64_t templates = max<uint64_t>(m_counters->templates.load(memory_order_relaxed), 1);
+
+    stringstream split;
+    for(size_t i = 0; i < static_cast<size_t>(extract_stage::count); i++)
+        split << (i ? ", " : "") << stage_names[i] << " " << to_string_form(total_ns ? 100.0 * stage_ns[i] / total_ns : 0.0, 1) << "% ("
+              << duration_to_string(duration<double, milli>(nanoseconds(stage_ns[i] / templates)), 2) << "/template)";
+
+    LOG(INFO) << "progress: time split - " << split.str();
+}
+
+/*!
+ * \brief Log the summary of the extract stage.
+ */
+void extract_progress::log_summary() const
+{
+    const double elapsed = elapsed_ns() / 1e9;
+    const uint64_t templates = m_counters->templates.load(memory_order_relaxed);
+    const uint64_t images = m_counters->images.load(memory_order_relaxed);
+
+    LOG(INFO) << "extract done: " << templates << " templates, " << images << " images in " << duration_to_string(duration<double, sec_t>(elapsed), 2)
+              << ", " << to_string_form(elapsed > 0 ? templates / elapsed : 0.0, 2) << " templates/s, " << to_string_form(elapsed > 0 ? images / elapsed : 0.0, 2) << " images/s";
+
+    log_stage_split();
+}
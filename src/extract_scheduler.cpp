@@ -0,0 +1,76 @@
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include "extract_scheduler.h"
+
+/*!
+ * \brief Create a scheduler over templates [0, count).
+ *
+ * \param count The count of templates to hand out.
+ * \param chunk_size The count of templates handed out by one next() call.
+ */
+extract_scheduler::extract_scheduler(size_t count, size_t chunk_size) : m_count(count), m_chunk_size(chunk_size)
+{
+    map_cursor();
+}
+
+/*!
+ * \brief Create a scheduler over the given templates in the given dispatch order.
+ *
+ * \param order The template indices to hand out, in dispatch order.
+ * \param chunk_size The count of templates handed out by one next() call.
+ */
+extract_scheduler::extract_scheduler(vector<size_t> order, size_t chunk_size) : m_order(move(order)), m_count(m_order.size()), m_chunk_size(chunk_size)
+{
+    map_cursor();
+}
+
+extract_scheduler::~extract_scheduler()
+{
+    munmap(m_cursor, sizeof(atomic<size_t>));
+}
+
+/*!
+ * \brief Map the shared cursor, it must be done before the extract workers are forked.
+ */
+void extract_scheduler::map_cursor()
+{
+    if(!m_chunk_size)
+        throw logic_error("extract chunk size must be greater than 0");
+
+    void* shared = mmap(nullptr, sizeof(atomic<size_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(shared == MAP_FAILED)
+        throw runtime_error("failed to map extract scheduler cursor");
+
+    m_cursor = new(shared) atomic<size_t>(0);
+
+    if(!m_cursor->is_lock_free())
+        throw runtime_error("extract scheduler cursor is not lock free, it can not be shared between processes");
+}
+
+/*!
+ * \brief Take the next chunk of templates.
+ *
+ * \param begin Output parameter to store the first dispatch position of the chunk.
+ * \param end Output parameter to store the position past the last template of the chunk.
+ *
+ * \return 'true' if a chunk was taken, 'false' if all templates are already handed out.
+ */
+bool extract_scheduler::next(size_t& begin, size_t& end)
+{
+    if(m_cursor->load(memory_order_relaxed) >= m_count)
+        return false;
+
+    begin = m_cursor->fetch_add(m_chunk_size, memory_order_relaxed);
+
+    if(begin >= m_count)
+        return false;
+
+    end = min(begin + m_chunk_size, m_count);
+
+    return true;
+}
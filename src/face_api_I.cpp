@@ -22,19 +22,16 @@ void FACEAPI_extract(shared_ptr<IdentInterface> face_api_ptr, params_type& param
         using Multiface = FACEAPITEST::Multiface;
         using TemplateRole = FACEAPITEST::TemplateRole;
         using ReturnCode = FACEAPITEST::ReturnCode;
+        using ImageRequirements = FACEAPITEST::ImageRequirements;
+        using ChannelOrder = FACEAPITEST::ChannelOrder;
     };
 
-    if(check_list_warn("db_list", params))
-        FACEAPI_extract_template<ident_traits, true>(face_api_ptr, params, output_dir, "db_list");
+    vector<string> list_names;
+    for(const char* list_name : {"db_list", "mate_list", "nonmate_list", "insert_list"})
+        if(check_list_warn(list_name, params))
+            list_names.push_back(list_name);
 
-    if(check_list_warn("mate_list", params))
-        FACEAPI_extract_template<ident_traits, false>(face_api_ptr, params, output_dir, "mate_list");
-
-    if(check_list_warn("nonmate_list", params))
-        FACEAPI_extract_template<ident_traits, false>(face_api_ptr, params, output_dir, "nonmate_list");
-
-    if(check_list_warn("insert_list", params))
-        FACEAPI_extract_template<ident_traits, false>(face_api_ptr, params, output_dir, "insert_list");
+    FACEAPI_extract_template<ident_traits>(face_api_ptr, params, output_dir, list_names, "db_list");
 }
 
 /*!
@@ -54,6 +51,26 @@ ReturnStatus createTemplateParam(shared_ptr<IdentInterface> face_api_ptr, const
     return face_api_ptr->createTemplate(faces, role, templ, eyeCoordinates);
 }
 
+/*!
+ * \brief Calls the createTemplateBatch function of the IdentInterface to create templates for a batch of faces.
+ *
+ * \param face_api_ptr A shared_ptr to an instance of IdentInterface representing the FACEAPI for identification.
+ * \param faces A constant reference to a vector of Multiface objects, one per template.
+ * \param role A TemplateRole representing the role of the templates.
+ * \param templs A reference to a vector where the created templates will be stored.
+ * \param eyeCoordinates A reference to a vector where the eye coordinates of each template will be stored.
+ * \param quality A reference to a vector of the quality values of each template (Cleared, not provided by the IdentInterface).
+ * \param statuses A reference to a vector where the status of each template creation will be stored.
+ *
+ * \return A ReturnStatus indicating the status of the batch.
+ */
+ReturnStatus createTemplateBatchParam(shared_ptr<IdentInterface> face_api_ptr, const vector<Multiface> &faces, TemplateRole role, vector<vector<uint8_t>> &templs, vector<vector<EyePair>> &eyeCoordinates, vector<vector<double>> &quality, vector<ReturnStatus> &statuses)
+{
+    quality.assign(faces.size(), vector<double>());
+
+    return face_api_ptr->createTemplateBatch(faces, role, templs, eyeCoordinates, statuses);
+}
+
 int string_id_to_annot_id(const string& string_id)
 {
     if(string_id == "none")
@@ -74,11 +91,9 @@ void FACEAPI::search(shared_ptr<IdentInterface> face_api_ptr, params_type& param
 {
     LOG(INFO) << "identifyTemplate start...";
 
-    uint desc_size = get_param<uint>(params["desc_size"]);
-
-    vector<pair< shared_ptr<in_out_desc_type>, bool >> arrs_desc;
-    arrs_desc.push_back({read_input_search(output_dir + "/" + get_filename(get_abs(params["mate_list"], params)) + ".bin", desc_size, "mate"), true});
-    arrs_desc.push_back({read_input_search(output_dir + "/" + get_filename(get_abs(params["nonmate_list"], params)) + ".bin", desc_size, "nonmate"), false});
+    vector<pair< shared_ptr<const desc_set>, bool >> arrs_desc;
+    arrs_desc.push_back({read_input_search(output_dir + "/" + get_filename(get_abs(params["mate_list"], params)) + ".bin", "mate"), true});
+    arrs_desc.push_back({read_input_search(output_dir + "/" + get_filename(get_abs(params["nonmate_list"], params)) + ".bin", "nonmate"), false});
 
     vector<uint> ranks(begin(mc_ranks), end(mc_ranks));
     uint nearest_count = get_param<uint>(params["nearest_count"]);
@@ -108,25 +123,32 @@ void FACEAPI::search(shared_ptr<IdentInterface> face_api_ptr, params_type& param
     size_t skip_queries = 0;
     for(auto& arr_desc : arrs_desc)
     {
-        for(auto& desc : *arr_desc.first)
+        const desc_set& descriptors = *arr_desc.first;
+        vector<uint8_t> descriptor;
+
+        for(size_t desc_index = 0; desc_index < descriptors.size(); desc_index++)
         {
-            if(desc.first == 0)
+            int label = descriptors.label(desc_index);
+
+            if(label == 0)
                 throw logic_error("can not do search, found image without label");
 
             vector<Candidate> candidateList;
             bool decision;
 
-            if(desc.first < 0)
+            if(label < 0)
             {
-                desc.first *= -1;
+                label *= -1;
                 candidateList.assign(nearest_count, {true, "none", 0});
                 decision = false;
                 skip_queries++;
             }
             else
             {
+                descriptor.assign(descriptors.row(desc_index), descriptors.row(desc_index) + descriptors.row_size(desc_index));
+
                 timer.start();
-                ReturnStatus status = face_api_ptr->identifyTemplate(desc.second, nearest_count, candidateList, decision);
+                ReturnStatus status = face_api_ptr->identifyTemplate(descriptor, nearest_count, candidateList, decision);
                 timer.stop();
 
                 if(status.code != ReturnCode::Success)
@@ -143,7 +165,7 @@ void FACEAPI::search(shared_ptr<IdentInterface> face_api_ptr, params_type& param
                     float score = 0;
                     for(size_t i = 0; i < matches_true_rank.first; i++)
                     {
-                        if(desc.first == string_id_to_annot_id(candidateList[i].templateId))
+                        if(label == string_id_to_annot_id(candidateList[i].templateId))
                         {
                             score = static_cast<float>(candidateList[i].similarityScore);
                             break;
@@ -158,7 +180,7 @@ void FACEAPI::search(shared_ptr<IdentInterface> face_api_ptr, params_type& param
 
             if(search_log)
             {
-                *search_log << "{" << desc.first << ", " << arr_desc.second << "} = ";
+                *search_log << "{" << label << ", " << arr_desc.second << "} = ";
                 for(const Candidate& cand : candidateList)
                     *search_log << "{" << cand.templateId << ", " << cand.similarityScore << "}, ";
                 *search_log << endl;
@@ -239,19 +261,28 @@ void FACEAPI::insert(shared_ptr<IdentInterface> face_api_ptr, params_type& param
 {
     LOG(INFO) << "galleryInsertID start...";
 
-    uint desc_size = get_param<uint>(params["desc_size"]);
+    auto descriptors_ins = read_input_search(output_dir + "/" + get_filename(get_abs(params["insert_list"], params)) + ".bin", "insert");
 
-    auto descriptors_ins = read_input_search(output_dir + "/" + get_filename(get_abs(params["insert_list"], params)) + ".bin", desc_size, "insert");
-    auto descriptors_db = read_input_search(output_dir + "/" + get_filename(get_abs(params["db_list"], params)) + ".bin", desc_size, "db");
+    // only the count of the db descriptors is needed, the header is enough
+    const size_t db_size = desc_file(output_dir + "/" + get_filename(get_abs(params["db_list"], params)) + ".bin", false).size();
 
     timing timer(true);
 
+    vector<uint8_t> descriptor;
+    uint desc_size = get_param<uint>(params["desc_size"]);
+
     static size_t counter_st = 0;
     size_t counter = 0;
-    for(const auto& desc : *descriptors_ins)
+    for(size_t desc_index = 0; desc_index < descriptors_ins->size(); desc_index++)
     {
+        // refused templates are stored empty, they are inserted zero-filled to keep the gallery ids of the insert list
+        if(descriptors_ins->label(desc_index) < 0)
+            descriptor.assign(desc_size, 0);
+        else
+            descriptor.assign(descriptors_ins->row(desc_index), descriptors_ins->row(desc_index) + descriptors_ins->row_size(desc_index));
+
         timer.start();
-        ReturnStatus status = face_api_ptr->galleryInsertID(desc.second, to_string(descriptors_db->size() + counter_st) + "_" + to_string(desc.first));
+        ReturnStatus status = face_api_ptr->galleryInsertID(descriptor, to_string(db_size + counter_st) + "_" + to_string(descriptors_ins->label(desc_index)));
         timer.stop();
 
         if(status.code != ReturnCode::Success)
@@ -264,7 +295,7 @@ void FACEAPI::insert(shared_ptr<IdentInterface> face_api_ptr, params_type& param
             LOG(INFO) << "insert " << counter << " descriptors";
     }
 
-    LOG(INFO) << "base, size after insert: " << descriptors_db->size() + counter_st;
+    LOG(INFO) << "base, size after insert: " << db_size + counter_st;
     LOG(INFO) << "galleryInsertID done, average time - " << duration_to_string(duration<double, milli>(timer.get_average()), 2);
     if(get_param<bool>(params["extra_timings"]))
         log_extended_info(timing::extended_info_cast<double, milli>(timer.get_extended_info(get_param<uint>(params["percentile"]) / 100.f)));
@@ -1,5 +1,10 @@
 #include <sstream>
 #include <fstream>
+#include <atomic>
+#include <thread>
+#include <numeric>
+#include <mutex>
+#include <cstdio>
 
 #include <glog/logging.h>
 
@@ -7,6 +12,8 @@
 #include "timing.h"
 #include "in_out_V.h"
 #include "face_api.h"
+#include "match_tiles.h"
+#include "ref_matcher.h"
 
 /*!
  * \brief Call the FACEAPI_extract_template function to perform face extraction.
@@ -26,9 +33,62 @@ void FACEAPI_extract(shared_ptr<Interface> face_api_ptr, params_type& params, co
         using Multiface = FACEAPITEST::Multiface;
         using TemplateRole = FACEAPITEST::TemplateRole;
         using ReturnCode = FACEAPITEST::ReturnCode;
+        using ImageRequirements = FACEAPITEST::ImageRequirements;
+        using ChannelOrder = FACEAPITEST::ChannelOrder;
     };
 
-    FACEAPI_extract_template<verif_traits, false>(face_api_ptr, params, output_dir, "extract_list");
+    FACEAPI_extract_template<verif_traits>(face_api_ptr, params, output_dir, {"extract_list"});
+}
+
+/*!
+ * \brief Create the reference matcher of the descriptors if the match engine calls for it.
+ *
+ * \param face_api_ptr A shared_ptr to the Interface representing the FACEAPI object.
+ * \param match_engine The match engine: vendor, reference or auto - the reference matcher if the engine declares its template layout.
+ * \param descriptors The descriptors to match.
+ *
+ * \return The reference matcher, nullptr if the templates are matched by matchTemplatesBatch.
+ */
+static unique_ptr<ref_matcher> make_ref_matcher(shared_ptr<Interface> face_api_ptr, const string& match_engine, const desc_set& descriptors)
+{
+    if(match_engine != "auto" && match_engine != "vendor" && match_engine != "reference")
+        throw logic_error("unknown match engine: " + match_engine + ", expected auto, vendor or reference");
+
+    if(match_engine == "vendor")
+        return nullptr;
+
+    TemplateLayout layout;
+    ReturnStatus status = face_api_ptr->getTemplateLayout(layout);
+
+    if(status.code != ReturnCode::Success)
+        throw runtime_error("getTemplateLayout failed, status: " + errcode_to_string(status.code));
+
+    if(layout.element == TemplateElement::Opaque)
+    {
+        if(match_engine == "reference")
+            throw logic_error("can not match with the reference matcher, the engine does not declare its template layout");
+
+        return nullptr;
+    }
+
+    // the vectorized kernels must agree with the scalar ones before they produce the scores
+    ref_matcher_self_check();
+
+    ref_element element = ref_element::float32;
+    if(layout.element == TemplateElement::Float16)
+        element = ref_element::float16;
+    else if(layout.element == TemplateElement::Int8)
+        element = ref_element::int8;
+
+    ref_metric metric = ref_metric::cosine;
+    if(layout.metric == TemplateMetric::Dot)
+        metric = ref_metric::dot;
+    else if(layout.metric == TemplateMetric::L2)
+        metric = ref_metric::l2;
+
+    LOG(INFO) << "template layout: " << layout.dimension << " " << ref_element_name(element) << " elements at offset " << layout.offset << ", " << ref_metric_name(metric) << " metric";
+
+    return unique_ptr<ref_matcher>(new ref_matcher(descriptors, element, metric, layout.offset, layout.dimension));
 }
 
 /*!
@@ -42,79 +102,249 @@ void FACEAPI_match(shared_ptr<Interface> face_api_ptr, params_type& params, cons
 {
     LOG(INFO) << "matchTemplates start...";
 
-    auto descriptors = read_input_match(output_dir + "/" + get_filename(get_abs(params["extract_list"], params)) + ".bin", get_param<uint>(params["desc_size"]), output_dir + "/" + "counters.txt");
+    auto descriptors = read_input_match(output_dir + "/" + get_filename(get_abs(params["extract_list"], params)) + ".bin", output_dir + "/" + "counters.txt");
 
-    vector<float> matches_true, matches_false;
+    uint match_threads = get_param<uint>(params["match_threads"]);
+    bool match_debug_flag = get_param<bool>(params["debug_info"]);
 
-    timing timer(true);
+    if(!match_threads)
+        throw logic_error("count match threads must be greater than 0");
 
-    const int log_step = 1000 * 1000;
-    size_t counter = 0;
-    size_t skip_match_count = 0;
+    LOG(INFO) << "count match threads: " << match_threads;
 
-    size_t desc_size = descriptors->size();
+    // the reference matcher compares the declared vectors itself, matchTemplatesBatch is not called then
+    const unique_ptr<ref_matcher> reference = make_ref_matcher(face_api_ptr, get_param<string>(params["match_engine"]), *descriptors);
+    const string batch_name = reference ? "reference matcher batch" : "matchTemplatesBatch";
 
-    bool match_debug_flag = get_param<bool>(params["debug_info"]);
+    LOG(INFO) << "match engine: " << (reference ? string("reference, isa ") + ref_matcher_isa() + ", self-check passed" : string("matchTemplatesBatch"));
+
+    size_t match_block = get_param<uint>(params["match_block"]);
+    if(!match_block)
+    {
+        const size_t cache_size = read_cache_size(2);
+        match_block = plan_match_block(*descriptors, cache_size);
+        LOG(INFO) << "L2 cache size: " << (cache_size ? to_string(cache_size / 1024) + " KB" : "unknown");
+    }
+
+    LOG(INFO) << "descriptors per match block: " << match_block;
 
+    // rows get shorter towards the end of the triangle, a few tiles per thread keep the threads busy until the end
+    vector<size_t> row_true_begin;
+    const vector<match_tile> tiles = plan_match_tiles(*descriptors, match_threads == 1 ? 1 : 16 * match_threads, row_true_begin);
+
+    const size_t desc_count = descriptors->size();
+    const size_t count_true = row_true_begin[desc_count];
+
+    vector<float> matches_true(count_true), matches_false(match_row_begin(desc_count, desc_count) - count_true);
+
+    // the debug log of a tile goes to its own file, the files are appended to match.txt in tile order as soon as they are done
     unique_ptr<ofstream> match_log;
     if(match_debug_flag)
         match_log = open_file_or_die<ofstream>(output_dir + "/match.txt");
 
-    for(size_t i = 0; i < desc_size - 1; i++)
-        for(size_t j = i + 1; j < desc_size; j++)
-        {
-            bool skip_match = false;
+    mutex match_log_mutex;
+    vector<bool> tile_log_done(match_debug_flag ? tiles.size() : 0, false);
+    size_t next_tile_log = 0;
+
+    auto tile_log_file = [&](size_t tile_index)
+    {
+        return output_dir + "/match.txt." + to_string(tile_index);
+    };
+
+    // a row is logged once all its column blocks are matched, so with debug output the rows are matched one by one
+    // to keep a single row of the log in memory, the column blocks and the batches stay the same
+    const size_t row_block = match_debug_flag ? 1 : match_block;
 
-            int id_i = (*descriptors)[i].first;
-            int id_j = (*descriptors)[j].first;
+    vector<timing> timers(match_threads, timing(true));
+    vector<nanoseconds> match_times(match_threads, nanoseconds(0));
+    vector<size_t> matched_pairs(match_threads, 0);
 
-            if(id_i == 0 || id_j == 0)
-                throw logic_error("can not matching, found image without label");
+    const size_t log_step = 1000 * 1000;
+    atomic<size_t> next_tile(0);
+    atomic<size_t> counter(0);
+    atomic<size_t> skip_match_count(0);
 
-            if(id_i < 0)
+    auto match_worker = [&](size_t thread_index)
+    {
+        timing& timer = timers[thread_index];
+
+        // the probe is copied out of the mapping into a reused buffer, the gallery templates are passed as views of the mapping
+        vector<uint8_t> desc_i;
+        vector<size_t> gallery_index;
+        vector<TemplateView> gallery;
+        vector<double> similarities;
+
+        // positions of the next true and false scores of each row of the tile
+        vector<size_t> true_pos, false_pos;
+        string row_log;
+
+        for(size_t tile_index = next_tile++; tile_index < tiles.size(); tile_index = next_tile++)
+        {
+            const match_tile& tile = tiles[tile_index];
+            const size_t tile_rows = tile.row_end - tile.row_begin;
+            size_t tile_counter = 0;
+            size_t tile_skip_count = 0;
+
+            true_pos.resize(tile_rows);
+            false_pos.resize(tile_rows);
+            for(size_t i = tile.row_begin; i < tile.row_end; i++)
             {
-                id_i *= -1;
-                skip_match = true;
+                true_pos[i - tile.row_begin] = row_true_begin[i];
+                false_pos[i - tile.row_begin] = match_row_begin(desc_count, i) - row_true_begin[i];
             }
 
-            if(id_j < 0)
+            unique_ptr<ofstream> tile_log;
+            if(match_debug_flag)
+                tile_log = open_file_or_die<ofstream>(tile_log_file(tile_index));
+
+            // a block of columns stays in the cache while the rows of a block of rows are matched against it
+            for(size_t i_block = tile.row_begin; i_block < tile.row_end; i_block += row_block)
             {
-                id_j *= -1;
-                skip_match = true;
+                const size_t i_block_end = min(tile.row_end, i_block + row_block);
+
+                for(size_t j_block = i_block + 1; j_block < desc_count; j_block += match_block)
+                {
+                    const size_t j_block_end = min(desc_count, j_block + match_block);
+
+                    for(size_t i = i_block; i < i_block_end; i++)
+                    {
+                        const size_t j_begin = max(j_block, i + 1);
+                        if(j_begin >= j_block_end)
+                            continue;
+
+                        // the pairs of the row within the block are matched by one call, refused templates are not matched
+                        const bool refused_i = descriptors->label(i) < 0;
+
+                        gallery_index.clear();
+                        if(!refused_i)
+                            for(size_t j = j_begin; j < j_block_end; j++)
+                                if(descriptors->label(j) > 0)
+                                    gallery_index.push_back(j);
+
+                        if(!gallery_index.empty() && reference)
+                        {
+                            timer.start();
+                            reference->match_batch(i, gallery_index, similarities);
+                            match_times[thread_index] += timer.stop();
+                            matched_pairs[thread_index] += gallery_index.size();
+                        }
+                        else if(!gallery_index.empty())
+                        {
+                            gallery.clear();
+                            for(size_t j : gallery_index)
+                                gallery.emplace_back(descriptors->row(j), descriptors->row_size(j));
+
+                            desc_i.assign(descriptors->row(i), descriptors->row(i) + descriptors->row_size(i));
+
+                            timer.start();
+                            ReturnStatus status = face_api_ptr->matchTemplatesBatch(desc_i, gallery, similarities);
+                            match_times[thread_index] += timer.stop();
+                            matched_pairs[thread_index] += gallery.size();
+
+                            if(status.code != ReturnCode::Success)
+                                throw runtime_error("matchTemplatesBatch failed, status: " + errcode_to_string(status.code));
+
+                            if(similarities.size() != gallery.size())
+                                throw runtime_error("matchTemplatesBatch returned " + to_string(similarities.size()) + " similarities for " + to_string(gallery.size()) + " templates");
+                        }
+
+                        size_t batch_index = 0;
+                        for(size_t j = j_begin; j < j_block_end; j++)
+                        {
+                            const int id_i = abs(descriptors->label(i));
+                            const int id_j = abs(descriptors->label(j));
+
+                            double similarity = 0;
+                            if(!refused_i && descriptors->label(j) > 0)
+                                similarity = similarities[batch_index++];
+                            else
+                                tile_skip_count++;
+
+                            if(id_i == id_j)
+                                matches_true[true_pos[i - tile.row_begin]++] = static_cast<float>(similarity);
+                            else
+                                matches_false[false_pos[i - tile.row_begin]++] = static_cast<float>(similarity);
+
+                            if(match_debug_flag)
+                                row_log += to_string(i) + " " + to_string(id_i) + " " + to_string(j) + " " + to_string(id_j) + " " + to_string_form(similarity, 7) + "\n";
+
+                            tile_counter++;
+                        }
+                    }
+                }
+
+                if(match_debug_flag)
+                {
+                    *tile_log << row_log;
+                    row_log.clear();
+                }
             }
 
-            double similarity = 0;
-            if(!skip_match)
+            if(match_debug_flag)
             {
-                timer.start();
-                ReturnStatus status = face_api_ptr->matchTemplates((*descriptors)[i].second, (*descriptors)[j].second, similarity);
-                timer.stop();
+                tile_log.reset();
+
+                lock_guard<mutex> lock(match_log_mutex);
+                tile_log_done[tile_index] = true;
 
-                if(status.code != ReturnCode::Success)
-                    throw runtime_error("matchTemplates failed, status: " + errcode_to_string(status.code));
+                for(; next_tile_log < tiles.size() && tile_log_done[next_tile_log]; next_tile_log++)
+                {
+                    unique_ptr<ifstream> done_log = open_file_or_die<ifstream>(tile_log_file(next_tile_log));
+                    // inserting an empty buffer would set the fail bit of match.txt
+                    if(done_log->peek() != ifstream::traits_type::eof())
+                        *match_log << done_log->rdbuf();
+                    done_log.reset();
+
+                    remove(tile_log_file(next_tile_log).c_str());
+                }
             }
-            else
-                skip_match_count++;
 
+            skip_match_count += tile_skip_count;
 
-            if(id_i == id_j)
-                matches_true.push_back(static_cast<float>(similarity));
-            else
-                matches_false.push_back(static_cast<float>(similarity));
+            const size_t prev_counter = counter.fetch_add(tile_counter);
+            if((prev_counter + tile_counter) / (10 * log_step) != prev_counter / (10 * log_step))
+                LOG(INFO) << "match " << (prev_counter + tile_counter) / log_step << "M descriptor pairs";
+        }
+    };
 
-            if(match_debug_flag)
-                *match_log << i << " " << id_i << " " << j << " " << id_j << " " << to_string_form(similarity, 7) << endl;
+    vector<thread> workers;
+    vector<exception_ptr> errors(match_threads);
 
-            counter++;
+    for(size_t i = 1; i < match_threads; i++)
+        workers.emplace_back([&, i]()
+        {
+            try
+            {
+                match_worker(i);
+            }
+            catch(...)
+            {
+                errors[i] = current_exception();
+            }
+        });
 
-            if(counter % (10 * log_step) == 0)
-                LOG(INFO) << "match " << counter/log_step << "M descriptor pairs";
-        }
+    try
+    {
+        match_worker(0);
+    }
+    catch(...)
+    {
+        errors[0] = current_exception();
+    }
+
+    wait_all_threads(workers, errors, "match");
+
+    timing timer(true);
+    for(const timing& thread_timer : timers)
+        timer.merge(thread_timer);
+
+    const nanoseconds match_time = accumulate(match_times.begin(), match_times.end(), nanoseconds(0));
+    const size_t match_count = accumulate(matched_pairs.begin(), matched_pairs.end(), size_t(0));
 
-    LOG(INFO) << "all matches count: " << counter;
+    LOG(INFO) << "all matches count: " << counter.load();
     LOG(INFO) << "matches true: " << matches_true.size();
     LOG(INFO) << "matches false: " << matches_false.size();
-    LOG(INFO) << "skip matches: " << skip_match_count;
+    LOG(INFO) << "skip matches: " << skip_match_count.load();
 
     write_output_match_search(output_dir + "/matches_true.bin", matches_true);
     write_output_match_search(output_dir + "/matches_false.bin", matches_false);
@@ -124,7 +354,8 @@ void FACEAPI_match(shared_ptr<Interface> face_api_ptr, params_type& params, cons
     check_median_modify(matches_true, {0.363f, 1.0f});
     check_median_modify(matches_false, {0.0f, 0.362f});
 
-    LOG(INFO) << "matchTemplates done, average time - " << duration_to_string(timer.get_average());
+    LOG(INFO) << batch_name << " of up to " << match_block << " templates, average batch time - " << duration_to_string(timer.get_average());
+    LOG(INFO) << (reference ? "reference match" : "matchTemplates") << " done, average time - " << duration_to_string(match_count ? match_time / static_cast<nanoseconds::rep>(match_count) : nanoseconds(-1));
     if(get_param<bool>(params["extra_timings"]))
         log_extended_info(timer.get_extended_info(get_param<uint>(params["percentile"]) / 100.f));
 }
@@ -169,6 +400,24 @@ ReturnStatus createTemplateParam(shared_ptr<Interface> face_api_ptr, const Multi
     return face_api_ptr->createTemplate(faces, role, templ, eyeCoordinates, quality);
 }
 
+/*!
+ * \brief Create face templates for a batch of multiple face images with additional parameters.
+ *
+ * \param face_api_ptr A shared pointer to the Interface class.
+ * \param faces The batch of Multiface objects, one per template.
+ * \param role The TemplateRole indicating the role of the templates.
+ * \param templs Output parameter for the created face templates.
+ * \param eyeCoordinates Output parameter for the eye coordinates of each template.
+ * \param quality Output parameter for the quality values of each template.
+ * \param statuses Output parameter for the status of each template creation.
+ *
+ * \return The ReturnStatus indicating the success or failure of the batch.
+ */
+ReturnStatus createTemplateBatchParam(shared_ptr<Interface> face_api_ptr, const vector<Multiface> &faces, TemplateRole role, vector<vector<uint8_t>> &templs, vector<vector<EyePair>> &eyeCoordinates, vector<vector<double>> &quality, vector<ReturnStatus> &statuses)
+{
+    return face_api_ptr->createTemplateBatch(faces, role, templs, eyeCoordinates, quality, statuses);
+}
+
 
 
 
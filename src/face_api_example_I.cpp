@@ -57,7 +57,6 @@ FaceApiExampleI::createTemplate(
     Mat image(face.height, face.width, CV_8UC3, face.data.get());
     Mat faces, aligned_face, feature;
 
-    cvtColor(image, image, COLOR_RGB2BGR);
     resize(image, image, {320,320});
 
     detector_->detect(image, faces);
@@ -88,6 +87,24 @@ FaceApiExampleI::createTemplate(
     return ReturnStatus(ReturnCode::RefuseInput);
 }
 
+/*!
+ * \brief Get the requirements to the input images, the detector works on 320x320 images.
+ *
+ * The example has always fed the models RGB images, converted from the BGR bytes of FreeImage,
+ * so it declares RGB to keep its scores.
+ *
+ * \param requirements The output structure to store the requirements.
+ *
+ * \return A `ReturnStatus` object indicating the success of the call.
+ */
+ReturnStatus
+FaceApiExampleI::getImageRequirements(ImageRequirements &requirements)
+{
+    requirements = ImageRequirements(320, 320, ChannelOrder::RGB);
+
+    return ReturnStatus(ReturnCode::Success);
+}
+
 /*!
  * \brief finalizeInit - Finalizes the initialization of the face recognition system.
  *
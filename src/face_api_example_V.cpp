@@ -54,7 +54,6 @@ FaceApiExampleV::createTemplate(
     Mat image(face.height, face.width, CV_8UC3, face.data.get());
     Mat faces, aligned_face, feature;
 
-    cvtColor(image, image, COLOR_RGB2BGR);
     resize(image, image, {320,320});
 
     detector_->detect(image, faces);
@@ -85,6 +84,39 @@ FaceApiExampleV::createTemplate(
     return ReturnStatus(ReturnCode::RefuseInput);
 }
 
+/*!
+ * \brief Get the requirements to the input images, the detector works on 320x320 images.
+ *
+ * The example has always fed the models RGB images, converted from the BGR bytes of FreeImage,
+ * so it declares RGB to keep its scores.
+ *
+ * \param requirements The output structure to store the requirements.
+ *
+ * \return A `ReturnStatus` object indicating the success of the call.
+ */
+ReturnStatus
+FaceApiExampleV::getImageRequirements(ImageRequirements &requirements)
+{
+    requirements = ImageRequirements(320, 320, ChannelOrder::RGB);
+
+    return ReturnStatus(ReturnCode::Success);
+}
+
+/*!
+ * \brief Get the layout of the templates, they are the 128 float features of SFace compared by cosine.
+ *
+ * \param layout The output structure to store the layout.
+ *
+ * \return A `ReturnStatus` object indicating the success of the call.
+ */
+ReturnStatus
+FaceApiExampleV::getTemplateLayout(TemplateLayout &layout)
+{
+    layout = TemplateLayout(TemplateElement::Float32, TemplateMetric::Cosine, 0, 128);
+
+    return ReturnStatus(ReturnCode::Success);
+}
+
 /*!
  * \brief Match two face templates to calculate their similarity score.
  *
@@ -0,0 +1,188 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "utils.h"
+#include "image_cache.h"
+
+static const char cache_magic[8] = {'F', 'M', 'I', 'M', 'G', 'C', '4', '\0'};
+
+/*!
+ * \brief Open the cache directory, create it if needed.
+ *
+ * \param cache_dir The directory of the cache files.
+ */
+image_cache::image_cache(const string& cache_dir) : m_cache_dir(cache_dir), m_hits(0), m_misses(0)
+{
+    if(mkdir(m_cache_dir.c_str(), 0755) && errno != EEXIST)
+        throw runtime_error("creating image cache dir " + m_cache_dir + " failed: " + strerror(errno));
+}
+
+/*!
+ * \brief Get the bitmap of an image from the cache, decode and store it on a miss.
+ *
+ * \param file The file path of the image.
+ * \param layout The pixel layout of the bitmap: RGB, BGR or grayscale.
+ * \param width Reference to store the width of the bitmap.
+ * \param height Reference to store the height of the bitmap.
+ * \param max_width The width the engine makes use of, see get_bitmap().
+ * \param max_height The height the engine makes use of, see get_bitmap().
+ * \param pool The pool to take the bitmap buffer from on a miss, nullptr to allocate it.
+ * \param timings The timings to add the stage times to, a hit counts as read, nullptr to skip timing.
+ *
+ * \return A shared_ptr to the bitmap data, the same bytes get_bitmap() returns.
+ */
+shared_ptr<uint8_t> image_cache::get_bitmap(const string& file, bitmap_layout layout, size_t& width, size_t& height, size_t max_width, size_t max_height, bitmap_pool* pool, bitmap_timings* timings)
+{
+    const auto tstart = high_resolution_clock::now();
+
+    struct stat file_stat;
+
+    if(stat(file.c_str(), &file_stat))
+        throw runtime_error("failed to open image " + file);
+
+    file_header header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.mtime_sec = static_cast<uint64_t>(file_stat.st_mtim.tv_sec);
+    header.mtime_nsec = static_cast<uint64_t>(file_stat.st_mtim.tv_nsec);
+    header.file_size = static_cast<uint64_t>(file_stat.st_size);
+    header.width = 0;
+    header.height = 0;
+    header.channels = static_cast<uint32_t>(bitmap_layout_channels(layout));
+    header.max_width = static_cast<uint32_t>(max_width);
+    header.max_height = static_cast<uint32_t>(max_height);
+    header.path_size = static_cast<uint32_t>(file.size());
+
+    stringstream cache_name;
+    cache_name << m_cache_dir << "/" << hex << hash<string>()(file + "|" + bitmap_layout_name(layout) + "|" + to_string(max_width) + "x" + to_string(max_height)) << ".img";
+    const string cache_file = cache_name.str();
+
+    shared_ptr<uint8_t> bitmap = load(cache_file, header, file, width, height);
+    if(bitmap)
+    {
+        if(timings)
+            timings->read += high_resolution_clock::now() - tstart;
+
+        m_hits++;
+        return bitmap;
+    }
+
+    m_misses++;
+
+    bitmap = ::get_bitmap(file, layout, width, height, max_width, max_height, pool, timings);
+
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    store(cache_file, header, file, bitmap.get());
+
+    return bitmap;
+}
+
+/*!
+ * \brief Map a cache file if it holds the bitmap of the given image version.
+ *
+ * \param cache_file The cache file path.
+ * \param expected The header expected for the image, width and height are not compared.
+ * \param file The file path of the image.
+ * \param width Reference to store the width of the bitmap.
+ * \param height Reference to store the height of the bitmap.
+ *
+ * \return A shared_ptr to the mapped bitmap data, empty on a miss.
+ */
+shared_ptr<uint8_t> image_cache::load(const string& cache_file, const file_header& expected, const string& file, size_t& width, size_t& height) const
+{
+    int cache_fd = open(cache_file.c_str(), O_RDONLY);
+
+    if(cache_fd < 0)
+        return nullptr;
+
+    struct stat cache_stat;
+    if(fstat(cache_fd, &cache_stat) || static_cast<size_t>(cache_stat.st_size) < sizeof(file_header))
+    {
+        close(cache_fd);
+        return nullptr;
+    }
+
+    const size_t map_size = static_cast<size_t>(cache_stat.st_size);
+    void* map_base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, cache_fd, 0);
+    close(cache_fd);
+
+    if(map_base == MAP_FAILED)
+        return nullptr;
+
+    uint8_t* cache_data = static_cast<uint8_t*>(map_base);
+    file_header header;
+    memcpy(&header, cache_data, sizeof(file_header));
+
+    const size_t data_offset = sizeof(file_header) + header.path_size;
+    const size_t bitmap_size = static_cast<size_t>(header.width) * header.height * header.channels;
+
+    if(memcmp(header.magic, expected.magic, sizeof(header.magic)) || header.mtime_sec != expected.mtime_sec || header.mtime_nsec != expected.mtime_nsec
+            || header.file_size != expected.file_size || header.channels != expected.channels || header.max_width != expected.max_width
+            || header.max_height != expected.max_height || header.path_size != expected.path_size
+            || map_size != data_offset + bitmap_size || memcmp(cache_data + sizeof(file_header), file.data(), file.size()))
+    {
+        munmap(map_base, map_size);
+        return nullptr;
+    }
+
+    width = header.width;
+    height = header.height;
+
+    return shared_ptr<uint8_t>(cache_data + data_offset, [map_base, map_size](uint8_t*) { munmap(map_base, map_size); });
+}
+
+/*!
+ * \brief Write the bitmap of an image to the cache, a failed write only skips caching of the image.
+ *
+ * \param cache_file The cache file path.
+ * \param header The header of the cache file.
+ * \param file The file path of the image.
+ * \param bitmap The bitmap data.
+ */
+void image_cache::store(const string& cache_file, const file_header& header, const string& file, const uint8_t* bitmap) const
+{
+    const string tmp_file = cache_file + ".tmp." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id()));
+    const size_t bitmap_size = static_cast<size_t>(header.width) * header.height * header.channels;
+
+    {
+        ofstream cache_stream(tmp_file, ofstream::binary);
+
+        cache_stream.write(reinterpret_cast<const char*>(&header), sizeof(file_header));
+        cache_stream.write(file.data(), static_cast<streamsize>(file.size()));
+        cache_stream.write(reinterpret_cast<const char*>(bitmap), static_cast<streamsize>(bitmap_size));
+
+        if(cache_stream.good())
+        {
+            cache_stream.close();
+
+            if(!cache_stream.fail() && !rename(tmp_file.c_str(), cache_file.c_str()))
+                return;
+        }
+    }
+
+    LOG(WARNING) << "failed to write image cache file " << cache_file;
+    remove(tmp_file.c_str());
+}
+
+/*!
+ * \brief Log the hit and miss counts of the cache.
+ *
+ * \param fork_index The index of the extract worker.
+ */
+void image_cache::log_stats(size_t fork_index) const
+{
+    LOG(INFO) << "proc " << fork_index << " - image cache: " << m_hits << " hits, " << m_misses << " misses";
+}
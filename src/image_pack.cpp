@@ -0,0 +1,270 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+#include "utils.h"
+#include "image_pack.h"
+
+static const char pack_magic[8] = {'F', 'M', 'I', 'M', 'G', 'P', 'K', '2'};
+static const size_t pack_alignment = 64;
+
+/*!
+ * \brief Map a pack file and build the index of its images.
+ *
+ * \param pack_file The file path of the pack.
+ */
+image_pack::image_pack(const string& pack_file)
+{
+    int pack_fd = open(pack_file.c_str(), O_RDONLY);
+
+    if(pack_fd < 0)
+        throw runtime_error("failed to open image pack " + pack_file);
+
+    struct stat pack_stat;
+    if(fstat(pack_fd, &pack_stat) || static_cast<size_t>(pack_stat.st_size) < sizeof(file_header))
+    {
+        close(pack_fd);
+        throw runtime_error("image pack " + pack_file + " is too short");
+    }
+
+    const size_t map_size = static_cast<size_t>(pack_stat.st_size);
+    void* map_base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, pack_fd, 0);
+    close(pack_fd);
+
+    if(map_base == MAP_FAILED)
+        throw runtime_error("failed to map image pack " + pack_file);
+
+    m_mapping = shared_ptr<uint8_t>(static_cast<uint8_t*>(map_base), [map_size](uint8_t* base) { munmap(base, map_size); });
+
+    memcpy(&m_header, m_mapping.get(), sizeof(file_header));
+
+    if(memcmp(m_header.magic, pack_magic, sizeof(pack_magic)) || m_header.layout > static_cast<uint32_t>(bitmap_layout::gray)
+            || m_header.channels != bitmap_layout_channels(layout())
+            || m_header.index_offset > map_size || m_header.count_images > (map_size - m_header.index_offset) / sizeof(index_entry)
+            || m_header.paths_offset > map_size)
+        throw runtime_error("image pack " + pack_file + " has a wrong header");
+
+    const index_entry* entries = reinterpret_cast<const index_entry*>(m_mapping.get() + m_header.index_offset);
+
+    m_index.reserve(m_header.count_images);
+    for(size_t i = 0; i < m_header.count_images; i++)
+    {
+        const index_entry& entry = entries[i];
+        const uint64_t bitmap_size = static_cast<uint64_t>(entry.width) * entry.height * (entry.depth / 8);
+
+        if(entry.depth != 8 * m_header.channels || entry.data_offset > m_header.index_offset || bitmap_size > m_header.index_offset - entry.data_offset
+                || entry.path_offset > map_size - m_header.paths_offset || entry.path_size > map_size - m_header.paths_offset - entry.path_offset)
+            throw runtime_error("image pack " + pack_file + " has a wrong index entry " + to_string(i));
+
+        const char* path = reinterpret_cast<const char*>(m_mapping.get() + m_header.paths_offset + entry.path_offset);
+        m_index.emplace(string(path, entry.path_size), &entry);
+    }
+}
+
+/*!
+ * \brief Get the bitmap of an image from the pack.
+ *
+ * \param path The path of the image relative to extract_prefix, as in the extract list.
+ * \param width Reference to store the width of the bitmap.
+ * \param height Reference to store the height of the bitmap.
+ *
+ * \return A shared_ptr to the bitmap data in the mapping, the same bytes get_bitmap() returns.
+ */
+shared_ptr<uint8_t> image_pack::get_bitmap(const string& path, size_t& width, size_t& height) const
+{
+    auto it = m_index.find(path);
+
+    if(it == m_index.end())
+        throw runtime_error("image pack has no image " + path);
+
+    width = it->second->width;
+    height = it->second->height;
+
+    return shared_ptr<uint8_t>(m_mapping, m_mapping.get() + it->second->data_offset);
+}
+
+/*!
+ * \brief Get the pixel layout the images are stored in.
+ *
+ * \return The layout: 24-bit RGB, 24-bit BGR or 8-bit grayscale.
+ */
+bitmap_layout image_pack::layout() const
+{
+    return static_cast<bitmap_layout>(m_header.layout);
+}
+
+/*!
+ * \brief Get the width JPEG images were decoded at a reduced scale down to, see get_bitmap().
+ *
+ * \return The width, 0 - full resolution.
+ */
+size_t image_pack::max_width() const
+{
+    return m_header.max_width;
+}
+
+/*!
+ * \brief Get the height JPEG images were decoded at a reduced scale down to, see get_bitmap().
+ *
+ * \return The height, 0 - full resolution.
+ */
+size_t image_pack::max_height() const
+{
+    return m_header.max_height;
+}
+
+/*!
+ * \brief Get the count of images in the pack.
+ *
+ * \return The count of images.
+ */
+size_t image_pack::size() const
+{
+    return m_index.size();
+}
+
+/*!
+ * \brief Decode images and write them to a pack file.
+ *
+ * \param pack_file The file path of the pack.
+ * \param paths The paths of the images relative to extract_prefix, duplicates are stored once.
+ * \param extract_prefix The path prefix of the image files.
+ * \param layout The pixel layout to store the images in: RGB, BGR or grayscale.
+ * \param max_width The width to decode JPEG images at a reduced scale down to, see get_bitmap() (0 - no limit).
+ * \param max_height The height to decode JPEG images at a reduced scale down to, see get_bitmap() (0 - no limit).
+ * \param count_threads The count of decode threads.
+ */
+void image_pack::write(const string& pack_file, const vector<string>& paths, const string& extract_prefix, bitmap_layout layout, size_t max_width, size_t max_height, uint count_threads)
+{
+    vector<string> unique_paths;
+    {
+        unordered_set<string> seen;
+        for(const string& path : paths)
+            if(seen.insert(path).second)
+                unique_paths.push_back(path);
+    }
+
+    if(!count_threads)
+        count_threads = 1;
+
+    unique_ptr<ofstream> pack_stream = open_file_or_die<ofstream>(pack_file, ofstream::binary);
+
+    // the header is zeroed until the pack is complete, an interrupted pack has no magic and is refused at once
+    file_header header;
+    memset(&header, 0, sizeof(file_header));
+    pack_stream->write(reinterpret_cast<const char*>(&header), sizeof(file_header));
+
+    header.count_images = unique_paths.size();
+    header.index_offset = 0;
+    header.paths_offset = 0;
+    header.channels = static_cast<uint32_t>(bitmap_layout_channels(layout));
+    header.max_width = static_cast<uint32_t>(max_width);
+    header.max_height = static_cast<uint32_t>(max_height);
+    header.layout = static_cast<uint32_t>(layout);
+
+    const char padding[pack_alignment] = {};
+    uint64_t offset = sizeof(file_header);
+
+    auto pad_to_alignment = [&]()
+    {
+        const size_t pad = (pack_alignment - offset % pack_alignment) % pack_alignment;
+        pack_stream->write(padding, static_cast<streamsize>(pad));
+        offset += pad;
+    };
+
+    vector<index_entry> entries(unique_paths.size());
+    uint64_t path_offset = 0;
+
+    // decode a batch in parallel, then append it in list order
+    const size_t batch_size = 64 * count_threads;
+    for(size_t first = 0; first < unique_paths.size(); first += batch_size)
+    {
+        const size_t last = min(unique_paths.size(), first + batch_size);
+
+        vector<shared_ptr<uint8_t>> bitmaps(last - first);
+        vector<size_t> widths(last - first, 0), heights(last - first, 0);
+        atomic<size_t> next_image(first);
+
+        auto decode_images = [&]()
+        {
+            for(size_t i = next_image++; i < last; i = next_image++)
+                bitmaps[i - first] = ::get_bitmap(extract_prefix + unique_paths[i], layout, widths[i - first], heights[i - first], max_width, max_height);
+        };
+
+        vector<thread> workers;
+        vector<exception_ptr> errors(count_threads);
+
+        for(uint i = 1; i < count_threads; i++)
+            workers.emplace_back([&, i]()
+            {
+                try
+                {
+                    decode_images();
+                }
+                catch(...)
+                {
+                    errors[i] = current_exception();
+                }
+            });
+
+        try
+        {
+            decode_images();
+        }
+        catch(...)
+        {
+            errors[0] = current_exception();
+        }
+
+        wait_all_threads(workers, errors);
+
+        for(size_t i = first; i < last; i++)
+        {
+            pad_to_alignment();
+
+            const size_t bitmap_size = widths[i - first] * heights[i - first] * header.channels;
+            pack_stream->write(reinterpret_cast<const char*>(bitmaps[i - first].get()), static_cast<streamsize>(bitmap_size));
+
+            entries[i] = {offset, path_offset, static_cast<uint32_t>(unique_paths[i].size()), static_cast<uint32_t>(widths[i - first]),
+                          static_cast<uint32_t>(heights[i - first]), 8 * header.channels};
+
+            offset += bitmap_size;
+            path_offset += unique_paths[i].size();
+        }
+
+        if(!pack_stream->good())
+            throw runtime_error("failed to write " + pack_file);
+
+        LOG(INFO) << "pack: " << last << "/" << unique_paths.size() << " images";
+    }
+
+    pad_to_alignment();
+    header.index_offset = offset;
+    pack_stream->write(reinterpret_cast<const char*>(entries.data()), static_cast<streamsize>(entries.size() * sizeof(index_entry)));
+    offset += entries.size() * sizeof(index_entry);
+
+    header.paths_offset = offset;
+    for(const string& path : unique_paths)
+        pack_stream->write(path.data(), static_cast<streamsize>(path.size()));
+
+    if(!pack_stream->good())
+        throw runtime_error("failed to write " + pack_file);
+
+    memcpy(header.magic, pack_magic, sizeof(pack_magic));
+
+    pack_stream->seekp(0);
+    pack_stream->write(reinterpret_cast<const char*>(&header), sizeof(file_header));
+    pack_stream->close();
+
+    if(pack_stream->fail())
+        throw runtime_error("failed to write " + pack_file);
+}
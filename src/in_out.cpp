@@ -1,46 +1,19 @@
-#include "in_out.h"
-
-class list_processor
-{
+#include <sys/stat.h>
 
-private:
-    shared_ptr<input_list_type> m_list;
-    size_t m_backet_size;
-    size_t m_extended_count;
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 
-public:
-    list_processor(shared_ptr<input_list_type> list, size_t size, uint count_proc) : m_list(list)
-    {
-        m_backet_size = size / count_proc;
-        m_extended_count = size % count_proc;
-    }
-
-    void add(const pair<vector<string>, int>& el)
-    {
-        size_t curr_backet_size = 0;
-
-        if(m_list->size() <= m_extended_count)
-            curr_backet_size = m_backet_size + 1;
-        else
-            curr_backet_size = m_backet_size;
-
-        if(m_list->empty() || m_list->back().size() == curr_backet_size)
-            m_list->emplace_back();
-
-        m_list->back().push_back(el);
-    }
-};
+#include "in_out.h"
 
 /*!
  * \brief Read input for extraction and create shared_ptr to input_list_type.
  *
  * \param file The file path containing the input data.
- * \param count_proc The number of extraction processes.
- * \param count_templ Output parameter to store the count of templates read.
  *
- * \return A shared_ptr to input_list_type containing the read input data.
+ * \return A shared_ptr to input_list_type containing the read templates in output order.
  */
-shared_ptr<input_list_type> read_input_extract(const string& file, uint count_proc, size_t& count_templ)
+shared_ptr<input_list_type> read_input_extract(const string& file)
 {
     unique_ptr<ifstream> input_stream = open_file_or_die<ifstream>(file);
 
@@ -88,11 +61,10 @@ shared_ptr<input_list_type> read_input_extract(const string& file, uint count_pr
     }
 
     auto retval = make_shared<input_list_type>();
-
-    list_processor processor(retval, keys.size() + list.size(), count_proc);
+    retval->reserve(keys.size() + list.size());
 
     for(const auto& one_pair : list)
-        processor.add({{one_pair.second}, one_pair.first});
+        retval->push_back({{one_pair.second}, one_pair.first});
 
     for(const auto& key : keys)
     {
@@ -102,87 +74,483 @@ shared_ptr<input_list_type> read_input_extract(const string& file, uint count_pr
         for(auto it = range.first; it != range.second; it++)
             paths.push_back(it->second);
 
-        processor.add({paths, key.second});
+        retval->push_back({paths, key.second});
     }
 
     LOG(INFO) << "count images: " << list_agg.size() + list.size();
     LOG(INFO) << "count templates: " << keys.size() + list.size();
-    LOG(INFO) << "count proc: " << count_proc;
-    LOG(INFO) << "templates per proc: " << (retval->empty() ? 0 : (*retval)[0].size());
 
     if(retval->empty())
         throw runtime_error("empty input list in file: " + file);
 
-    count_templ = keys.size() + list.size();
-
     return retval;
 }
 
 /*!
- * \brief Write a manifest file based on the descriptors read from the desc_file.
+ * \brief Create the descriptor file with its final size, so extract workers can write to their offsets without locking.
  *
- * \param out_file The file path to write the manifest data.
- * \param desc_file The file path containing the descriptor data.
- * \param desc_size The descriptor size.
+ * \param file_desc The file path of the descriptor data.
+ * \param count_templ The count of templates in the input list.
+ * \param desc_size The maximum descriptor size.
  */
-void write_manifest(const string& out_file, const string& desc_file, uint desc_size)
+void preallocate_output_extract(const string& file_desc, size_t count_templ, uint desc_size)
 {
-    shared_ptr<in_out_desc_type> descriptors = read_input_match_search(desc_file, desc_size, false, "db");
-    unique_ptr<ofstream> manifest_stream = open_file_or_die<ofstream>(out_file);
+    desc_file::create(file_desc, count_templ, desc_size);
+}
+
+/*!
+ * \brief Store the refusal count and the checksum in the header of the descriptor file once all extract workers are done.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param manifest_file The file path to write the manifest of the descriptor file to, empty for none.
+ */
+void finalize_output_extract(const string& file_desc, const string& manifest_file)
+{
+    if(manifest_file.empty())
+    {
+        desc_file::finalize(file_desc);
+        return;
+    }
 
-    size_t counter = 0;
-    for(const auto& desc : *descriptors)
+    // finalize walks the labels and the offset table anyway, the manifest is built from its copy of them
+    vector<int> labels;
+    vector<uint64_t> offsets;
+    desc_file::finalize(file_desc, &labels, &offsets);
+
+    write_manifest(manifest_file, labels, offsets);
+}
+
+/*!
+ * \brief Write a buffer to a file descriptor at the given offset or throw an exception.
+ *
+ * \param fd The file descriptor to write to.
+ * \param data The data to write.
+ * \param size The size of the data in bytes.
+ * \param offset The file offset to write the data at.
+ * \param file The file path used in the error message.
+ */
+void pwrite_or_die(int fd, const void* data, size_t size, size_t offset, const string& file)
+{
+    const uint8_t* pos = static_cast<const uint8_t*>(data);
+
+    while(size)
     {
-        if(desc.first >= 0)
-            *manifest_stream << to_string(counter) + "_" + to_string(desc.first) << " " << desc_size << " " << sizeof(int) + counter * (desc_size + sizeof(int)) << endl;
+        ssize_t written = pwrite(fd, pos, size, static_cast<off_t>(offset));
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
 
-        counter++;
+            throw runtime_error("failed to write " + file + ": " + strerror(errno));
+        }
+
+        pos += written;
+        offset += static_cast<size_t>(written);
+        size -= static_cast<size_t>(written);
     }
 }
 
 /*!
- * \brief Read input for match or search and create shared_ptr to in_out_desc_type.
+ * \brief Get the file path of an extract worker shard of a text output file.
  *
- * \param file The file path containing the input data.
- * \param desc_size The descriptor size.
- * \param match_log A boolean flag indicating whether to log match count (not used in this function).
- * \param log_prefix The log prefix to use in case of logging (not used in this function).
- * \param counters_file The file path to write the count of descriptors and refusals (not used in this function).
+ * \param file The file path of the merged output file.
+ * \param fork_index The index of the extract worker.
  *
- * \return A shared_ptr to in_out_desc_type containing the read input data.
+ * \return The file path of the worker shard.
  */
-shared_ptr<in_out_desc_type> read_input_match_search(const string& file, uint desc_size, bool match_log, const string& log_prefix, const string& counters_file)
+string shard_name(const string& file, size_t fork_index)
 {
-    unique_ptr<ifstream> desc_binstream = open_file_or_die<ifstream>(file, ifstream::binary);
+    return file + ".part" + to_string(fork_index);
+}
 
-    auto descriptors = make_shared<in_out_desc_type>();
+/*!
+ * \brief Append the extract worker shards to the output file in the worker order and remove them.
+ *
+ * \param file The file path of the merged output file.
+ * \param count_proc The count of extract workers.
+ */
+void merge_shards(const string& file, uint count_proc)
+{
+    unique_ptr<ofstream> out_stream = open_file_or_die<ofstream>(file, ofstream::app);
 
-    size_t refusal_count = 0;
-    while(true)
+    for(uint i = 0; i < count_proc; i++)
+    {
+        const string shard = shard_name(file, i);
+
+        {
+            ifstream shard_stream(shard, ifstream::binary);
+
+            if(!shard_stream.is_open())
+                continue;
+
+            if(shard_stream.peek() != ifstream::traits_type::eof())
+                *out_stream << shard_stream.rdbuf();
+        }
+
+        remove(shard.c_str());
+    }
+}
+
+/*!
+ * \brief Get the size of a file.
+ *
+ * \param file The file path.
+ *
+ * \return The size of the file in bytes, 0 if the file does not exist.
+ */
+static size_t file_size_or_zero(const string& file)
+{
+    struct stat file_stat;
+
+    if(stat(file.c_str(), &file_stat))
+        return 0;
+
+    return static_cast<size_t>(file_stat.st_size);
+}
+
+/*!
+ * \brief Parse a journal file up to its last commit.
+ *
+ * \param journal_file The journal file path.
+ * \param committed Output parameter to append the committed template index ranges.
+ * \param sizes Output parameter to store the text output file sizes recorded with the last commit.
+ * \param committed_length Output parameter to store the length of the journal up to the last commit in bytes.
+ */
+static void parse_extract_journal(const string& journal_file, extract_chunks_type& committed, vector<size_t>& sizes, size_t& committed_length)
+{
+    committed_length = 0;
+
+    ifstream journal_stream(journal_file);
+
+    if(!journal_stream.is_open())
+        return;
+
+    extract_chunks_type pending;
+    size_t length = 0;
+    string line;
+    while(getline(journal_stream, line))
     {
-        descriptors->emplace_back();
-        auto& desc = descriptors->back();
-        desc.second.resize(desc_size);
+        if(journal_stream.eof())
+            break;
+
+        length += line.size() + 1;
+
+        stringstream line_stream(line);
+        string tag;
+        line_stream >> tag;
+
+        if(tag == "c")
+        {
+            size_t begin = 0, end = 0;
+            line_stream >> begin >> end;
 
-        desc_binstream->read(reinterpret_cast<char*>(&desc.first), sizeof(int));
-        desc_binstream->read(reinterpret_cast<char*>(desc.second.data()), desc_size);
+            if(line_stream.fail() || begin >= end)
+                break;
 
-        if(desc_binstream->fail())
+            pending.emplace_back(begin, end);
+        }
+        else if(tag == "s")
         {
-            descriptors->pop_back();
+            vector<size_t> commit_sizes;
+            size_t size = 0;
+            while(line_stream >> size)
+                commit_sizes.push_back(size);
+
+            committed.insert(committed.end(), pending.begin(), pending.end());
+            pending.clear();
+            sizes = commit_sizes;
+            committed_length = length;
+        }
+        else
             break;
+    }
+}
+
+/*!
+ * \brief Check that an existing descriptor file was created for the input list, so an interrupted extract can be resumed.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param count_templ The count of templates in the input list.
+ * \param desc_size The maximum descriptor size.
+ *
+ * \return 'true' if the descriptor file is already finalized.
+ */
+bool check_output_extract_size(const string& file_desc, size_t count_templ, uint desc_size)
+{
+    try
+    {
+        return desc_file::check(file_desc, count_templ, desc_size);
+    }
+    catch(const exception& e)
+    {
+        throw runtime_error(string("can not resume extract, ") + e.what());
+    }
+}
+
+/*!
+ * \brief Append the chunks committed by an extract worker to its journal shard.
+ *
+ * \param journal_file The worker shard file path of the journal.
+ * \param chunks The template index ranges written to the descriptor file.
+ * \param text_shards The worker shard file paths of the text output files, their sizes are recorded with the commit.
+ */
+void append_extract_journal(const string& journal_file, const extract_chunks_type& chunks, const vector<string>& text_shards)
+{
+    stringstream buf;
+
+    for(const auto& chunk : chunks)
+        buf << "c " << chunk.first << " " << chunk.second << "\n";
+
+    buf << "s";
+    for(const string& shard : text_shards)
+        buf << " " << file_size_or_zero(shard);
+    buf << "\n";
+
+    unique_ptr<ofstream> journal_stream = open_file_or_die<ofstream>(journal_file, ofstream::app);
+    *journal_stream << buf.rdbuf();
+    journal_stream->flush();
+
+    if(journal_stream->fail())
+        throw runtime_error("failed to write " + journal_file);
+}
+
+/*!
+ * \brief Cut the worker shards of an interrupted extract run to their last commit and merge them into the main files.
+ *
+ * \param journal_file The file path of the merged journal.
+ * \param text_files The file paths of the merged text output files, in the order their sizes are recorded in the journal.
+ */
+void consolidate_extract_journal(const string& journal_file, const vector<string>& text_files)
+{
+    uint count_shards = 0;
+    while(!access(shard_name(journal_file, count_shards).c_str(), F_OK))
+        count_shards++;
+
+    for(uint i = 0; i < count_shards; i++)
+    {
+        extract_chunks_type committed;
+        vector<size_t> sizes;
+        size_t committed_length = 0;
+
+        const string journal_shard = shard_name(journal_file, i);
+        parse_extract_journal(journal_shard, committed, sizes, committed_length);
+
+        if(truncate(journal_shard.c_str(), static_cast<off_t>(committed_length)))
+            throw runtime_error("failed to truncate " + journal_shard);
+
+        for(size_t j = 0; j < text_files.size(); j++)
+        {
+            const string text_shard = shard_name(text_files[j], i);
+
+            if(access(text_shard.c_str(), F_OK))
+                continue;
+
+            if(truncate(text_shard.c_str(), static_cast<off_t>(j < sizes.size() ? sizes[j] : 0)))
+                throw runtime_error("failed to truncate " + text_shard);
         }
+    }
+
+    LOG(INFO) << "resume: merge " << count_shards << " journal shards of the interrupted run";
+
+    merge_shards(journal_file, count_shards);
+    for(const string& text_file : text_files)
+        if(!access(text_file.c_str(), F_OK) || !access(shard_name(text_file, 0).c_str(), F_OK))
+            merge_shards(text_file, count_shards);
+}
+
+/*!
+ * \brief Read the merged journal and mark the templates already written to the descriptor file.
+ *
+ * \param journal_file The file path of the merged journal.
+ * \param count_templ The count of templates in the input list.
+ *
+ * \return A vector of flags, 'true' for each committed template.
+ */
+vector<bool> read_extract_journal(const string& journal_file, size_t count_templ)
+{
+    extract_chunks_type committed;
+    vector<size_t> sizes;
+    size_t committed_length = 0;
+
+    parse_extract_journal(journal_file, committed, sizes, committed_length);
+
+    vector<bool> done(count_templ, false);
+    for(const auto& chunk : committed)
+    {
+        if(chunk.second > count_templ)
+            throw runtime_error("can not resume extract, " + journal_file + " does not match the input list");
 
-        if(desc.first < 0)
-            refusal_count++;
+        fill(done.begin() + static_cast<long>(chunk.first), done.begin() + static_cast<long>(chunk.second), true);
     }
 
+    return done;
+}
+
+/*!
+ * \brief Check the labels and descriptor sizes of the committed templates in the descriptor file.
+ *
+ * A committed template must have the label of the input list, negative if it was refused, and a size
+ * entry of 0 for a refusal and of 1 to desc_size otherwise.
+ *
+ * \param file_desc The file path of the descriptor data.
+ * \param input_list A shared_ptr to input_list_type containing the input data.
+ * \param desc_size The maximum descriptor size.
+ * \param finalized_flag Flag to indicate whether the descriptor file is finalized, its table then holds offsets instead of sizes.
+ * \param done The committed template flags, cleared for templates that failed the check.
+ *
+ * \return The count of committed templates that failed the check.
+ */
+size_t verify_output_extract(const string& file_desc, shared_ptr<const input_list_type> input_list, uint desc_size, bool finalized_flag, vector<bool>& done)
+{
+    int desc_bin_fd = open(file_desc.c_str(), O_RDONLY);
+
+    if(desc_bin_fd < 0)
+        throw runtime_error("failed to open " + file_desc);
+
+    const size_t count_templ = input_list->size();
+
+    size_t count_failed = 0;
+    for(size_t i = 0; i < done.size(); i++)
+    {
+        if(!done[i])
+            continue;
+
+        int label = 0;
+        uint64_t table[2] = {0, 0};
+
+        const size_t table_size = finalized_flag ? sizeof(table) : sizeof(uint64_t);
+        const bool read_flag = pread(desc_bin_fd, &label, sizeof(int), static_cast<off_t>(desc_file::label_offset(i))) == sizeof(int) &&
+                               pread(desc_bin_fd, table, table_size, static_cast<off_t>(desc_file::table_offset(count_templ, i))) == static_cast<ssize_t>(table_size);
+
+        // a finalized table holds the offsets, the size is the distance to the next one
+        const uint64_t size = finalized_flag ? table[1] - table[0] : table[0];
+        const bool size_flag = label < 0 ? size == 0 : size >= 1 && size <= desc_size;
+
+        if(!read_flag || abs(label) != abs((*input_list)[i].second) || !size_flag)
+        {
+            done[i] = false;
+            count_failed++;
+        }
+    }
+
+    close(desc_bin_fd);
+
+    return count_failed;
+}
+
+/*!
+ * \brief Write a manifest file with the sizes and offsets of the descriptors in the descriptor file, computed from the offset table without reading the descriptors.
+ *
+ * \param out_file The file path to write the manifest data.
+ * \param labels The labels of all templates of the descriptor file, negative for refused ones.
+ * \param offsets The offsets of the descriptors from the beginning of the descriptor file, one more than the labels.
+ */
+void write_manifest(const string& out_file, const vector<int>& labels, const vector<uint64_t>& offsets)
+{
+    unique_ptr<ofstream> manifest_stream = open_file_or_die<ofstream>(out_file);
+
+    for(size_t i = 0; i < labels.size(); i++)
+        if(labels[i] >= 0)
+            *manifest_stream << to_string(i) + "_" + to_string(labels[i]) << " " << offsets[i + 1] - offsets[i] << " " << offsets[i] << endl;
+}
+
+/*!
+ * \brief Merge the pending templates of several input lists into one list, templates with the same image paths are extracted once.
+ *
+ * \param input_lists The input lists.
+ * \param pending The indices of the pending templates of each input list, in ascending order.
+ * \param destinations The (list index, template index) pairs each merged template is written to.
+ *
+ * \return A shared_ptr to input_list_type containing the merged templates in order of the first appearance, labels are not set.
+ */
+shared_ptr<input_list_type> merge_input_extract(const vector<shared_ptr<input_list_type>>& input_lists, const vector<vector<size_t>>& pending, extract_destinations_type& destinations)
+{
+    shared_ptr<input_list_type> merged = make_shared<input_list_type>();
+    map<vector<string>, size_t> merged_index;
+
+    destinations.clear();
+
+    for(size_t list_index = 0; list_index < input_lists.size(); list_index++)
+    {
+        for(size_t templ_index : pending[list_index])
+        {
+            const vector<string>& paths = (*input_lists[list_index])[templ_index].first;
+
+            auto inserted = merged_index.emplace(paths, merged->size());
+            if(inserted.second)
+            {
+                merged->emplace_back(paths, 0);
+                destinations.emplace_back();
+            }
+
+            destinations[inserted.first->second].emplace_back(list_index, templ_index);
+        }
+    }
+
+    return merged;
+}
+
+/*!
+ * \brief Order templates by decreasing cost, estimated as the count of pixels of their images read from the image headers.
+ *
+ * \param input_list The templates.
+ * \param extract_prefix The path prefix of the image files.
+ * \param count_threads The count of threads reading the image headers.
+ *
+ * \return The template indices, the most expensive first, ties in input order.
+ */
+vector<size_t> order_input_extract_by_cost(const input_list_type& input_list, const string& extract_prefix, uint count_threads)
+{
+    vector<string> files;
+    for(const auto& templ : input_list)
+        for(const string& path : templ.first)
+            files.push_back(extract_prefix + path);
+
+    const vector<uint64_t> pixels = read_image_pixels(files, count_threads);
+
+    vector<uint64_t> costs(input_list.size(), 0);
+    size_t file_index = 0;
+    for(size_t i = 0; i < input_list.size(); i++)
+        for(size_t j = 0; j < input_list[i].first.size(); j++)
+            costs[i] += pixels[file_index++];
+
+    vector<size_t> order(input_list.size());
+    iota(order.begin(), order.end(), 0);
+
+    stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    if(!order.empty())
+        LOG(INFO) << "cost order: " << files.size() << " image headers read, template cost from " << to_string_form(costs[order.back()] / 1e6, 2)
+                  << " to " << to_string_form(costs[order.front()] / 1e6, 2) << " Mpix, median " << to_string_form(costs[order[order.size() / 2]] / 1e6, 2) << " Mpix";
+
+    return order;
+}
+
+/*!
+ * \brief Map the descriptor file for match or search and check it against its checksum.
+ *
+ * \param file The file path containing the input data.
+ * \param match_log A boolean flag indicating whether to log match count.
+ * \param log_prefix The log prefix to use in case of logging.
+ * \param counters_file The file path to write the count of descriptors and refusals, empty for none.
+ *
+ * \return A shared_ptr to the desc_set viewing the mapped file.
+ */
+shared_ptr<const desc_set> read_input_match_search(const string& file, bool match_log, const string& log_prefix, const string& counters_file)
+{
+    const desc_file descriptors_file(file);
+    auto descriptors = make_shared<const desc_set>(descriptors_file.descriptors());
+
     size_t desc_count = descriptors->size();
+    size_t refusal_count = descriptors_file.refusal_count();
 
     if(!desc_count)
         throw runtime_error("empty descriptors file: " + file);
 
-    LOG(INFO) << (log_prefix.empty() ? "" : log_prefix + " ") << "descriptors count: " << desc_count;
+    const size_t accept_count = desc_count - refusal_count;
+    LOG(INFO) << (log_prefix.empty() ? "" : log_prefix + " ") << "descriptors count: " << desc_count << ", descriptor size: up to " << descriptors_file.desc_size()
+              << ", average " << (accept_count ? descriptors_file.descriptors_size() / accept_count : 0);
     if(match_log)
         LOG(INFO) << "match count: " << desc_count * (desc_count - 1) / 2;
     LOG(INFO) << (log_prefix.empty() ? "" : log_prefix + " ") << "REFUSAL count: " << refusal_count;
@@ -1,17 +1,16 @@
 #include "in_out_I.h"
 
 /*!
- * \brief Read input for search and create shared_ptr to in_out_desc_type.
+ * \brief Map the descriptor file for search or insert.
  *
  * \param file The file path containing the input data.
- * \param desc_size The descriptor size.
  * \param log_prefix The log prefix to use in case of logging.
  *
- * \return A shared_ptr to in_out_desc_type containing the read input data.
+ * \return A shared_ptr to the desc_set viewing the mapped file.
  */
-shared_ptr<in_out_desc_type> read_input_search(const string& file, uint desc_size, const string& log_prefix)
+shared_ptr<const desc_set> read_input_search(const string& file, const string& log_prefix)
 {
-    return read_input_match_search(file, desc_size, false, log_prefix);
+    return read_input_match_search(file, false, log_prefix);
 }
 
 /*!
@@ -0,0 +1,65 @@
+#include <sstream>
+
+#include <glog/logging.h>
+#include <FreeImage.h>
+
+#include "utils_pack.h"
+#include "in_out.h"
+#include "image_pack.h"
+#include "timing.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        google::InitGoogleLogging(argv[0]);
+        google::InstallFailureSignalHandler();
+        FLAGS_stderrthreshold = 0;
+        FLAGS_colorlogtostderr = true;
+
+        params_type params = parse_cmd_line(argc, argv);
+
+        print_all(params);
+
+        vector<string> paths;
+
+        stringstream lists_stream(get_param<string>(params["lists"]));
+        string list;
+        while(getline(lists_stream, list, ','))
+        {
+            if(list.empty())
+                continue;
+
+            auto input_list = read_input_extract(relative_to_abs(list, params));
+
+            for(const auto& templ : *input_list)
+                paths.insert(paths.end(), templ.first.begin(), templ.first.end());
+        }
+
+        const string pack_file = get_abs(params["image_pack"], params);
+        const bitmap_layout layout = get_param<bool>(params["grayscale"]) ? bitmap_layout::gray : bitmap_layout_from_name(get_param<string>(params["channel_order"]));
+
+        LOG(INFO) << "pack start for " << pack_file << "...";
+
+        timing timer;
+        timer.start();
+
+        FreeImage_Initialise();
+        image_pack::write(pack_file, paths, get_abs(params["extract_prefix"], params) + "/", layout,
+                          get_param<uint>(params["max_width"]), get_param<uint>(params["max_height"]), get_param<uint>(params["count_threads"]));
+        FreeImage_DeInitialise();
+
+        auto interval = timer.stop();
+        LOG(INFO) << "pack done, time - " << duration_to_string(duration<double, sec_t>(interval), 2);
+    }
+
+    catch(const exception& e)
+    {
+        LOG(ERROR) << e.what();
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "match_tiles.h"
+
+/*!
+ * \brief Split the match triangle of a descriptor set into tiles with about the same count of pairs.
+ *
+ * \param descriptors The descriptor set, all labels must be non-zero.
+ * \param count_tiles The desired count of tiles, fewer are made if there are not enough rows.
+ * \param row_true_begin Reference to store the position of the first same-label score of each row among the true matches,
+ *                       one more element than descriptors, the last one is the count of true matches.
+ *
+ * \return The tiles in row order.
+ */
+vector<match_tile> plan_match_tiles(const desc_set& descriptors, size_t count_tiles, vector<size_t>& row_true_begin)
+{
+    const size_t count_desc = descriptors.size();
+
+    // the true pairs of row i are the later descriptors with the same label, counted walking the rows backwards
+    vector<size_t> row_true(count_desc, 0);
+    unordered_map<int, size_t> later_count;
+
+    for(size_t i = count_desc; i-- > 0;)
+    {
+        if(descriptors.label(i) == 0)
+            throw logic_error("can not matching, found image without label");
+
+        size_t& count = later_count[abs(descriptors.label(i))];
+        row_true[i] = count;
+        count++;
+    }
+
+    row_true_begin.assign(count_desc + 1, 0);
+    for(size_t i = 0; i < count_desc; i++)
+        row_true_begin[i + 1] = row_true_begin[i] + row_true[i];
+
+    const size_t count_pairs = match_row_begin(count_desc, count_desc);
+    const size_t tile_pairs = max<size_t>(1, (count_pairs + max<size_t>(1, count_tiles) - 1) / max<size_t>(1, count_tiles));
+
+    vector<match_tile> tiles;
+    size_t row_begin = 0;
+
+    for(size_t i = 0; i + 1 < count_desc; i++)
+    {
+        if(match_row_begin(count_desc, i + 1) - match_row_begin(count_desc, row_begin) >= tile_pairs || i + 2 == count_desc)
+        {
+            tiles.push_back({row_begin, i + 1});
+            row_begin = i + 1;
+        }
+    }
+
+    return tiles;
+}
+
+/*!
+ * \brief Get the size of a data cache of the first CPU as reported by sysfs.
+ *
+ * \param level The cache level.
+ *
+ * \return The cache size in bytes, 0 if it is unknown.
+ */
+size_t read_cache_size(uint level)
+{
+    const string cache_dir = "/sys/devices/system/cpu/cpu0/cache/index";
+
+    for(int index = 0; ; index++)
+    {
+        ifstream level_stream(cache_dir + to_string(index) + "/level");
+        ifstream type_stream(cache_dir + to_string(index) + "/type");
+        ifstream size_stream(cache_dir + to_string(index) + "/size");
+
+        if(!level_stream || !type_stream || !size_stream)
+            return 0;
+
+        uint cache_level = 0;
+        string type;
+        size_t size = 0;
+        string unit;
+
+        // the size is given as e.g. 48K or 2048K
+        if(!(level_stream >> cache_level) || !(type_stream >> type) || !(size_stream >> size))
+            return 0;
+        size_stream >> unit;
+
+        if(cache_level != level || type == "Instruction")
+            continue;
+
+        if(unit == "K")
+            size *= 1024;
+        else if(unit == "M")
+            size *= 1024 * 1024;
+
+        return size;
+    }
+}
+
+/*!
+ * \brief Choose the count of descriptors per block of the blocked match traversal.
+ *
+ * \param descriptors The descriptor set.
+ * \param cache_size The cache size in bytes, 0 if it is unknown.
+ *
+ * \return The count of descriptors per block.
+ */
+size_t plan_match_block(const desc_set& descriptors, size_t cache_size)
+{
+    const size_t default_cache_size = 1024 * 1024;
+    const size_t min_block = 16;
+    const size_t cache_line = 64;
+
+    size_t desc_bytes = 0;
+    for(size_t i = 0; i < descriptors.size(); i++)
+        desc_bytes += descriptors.row_size(i);
+
+    // a descriptor takes at least a cache line, packed descriptors share lines only at their ends
+    const size_t avg_size = max(cache_line, descriptors.empty() ? cache_line : desc_bytes / descriptors.size());
+    const size_t block = (cache_size ? cache_size : default_cache_size) / 2 / avg_size;
+
+    return max(min_block, block);
+}
@@ -0,0 +1,380 @@
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_CONVERT_X86
+#endif
+
+#include "pixel_convert.h"
+
+/*!
+ * \brief Get the count of bytes per pixel of a layout.
+ *
+ * \param layout The layout.
+ *
+ * \return 1 for grayscale, 3 for color layouts.
+ */
+size_t bitmap_layout_channels(bitmap_layout layout)
+{
+    return layout == bitmap_layout::gray ? 1 : 3;
+}
+
+/*!
+ * \brief Get the name of a layout.
+ *
+ * \param layout The layout.
+ *
+ * \return "rgb", "bgr" or "gray".
+ */
+const char* bitmap_layout_name(bitmap_layout layout)
+{
+    switch(layout)
+    {
+    case bitmap_layout::rgb:
+        return "rgb";
+    case bitmap_layout::bgr:
+        return "bgr";
+    default:
+        return "gray";
+    }
+}
+
+/*!
+ * \brief Get a layout by its name.
+ *
+ * \param name The name: "rgb" or "bgr".
+ *
+ * \return The color layout.
+ *
+ * \throws logic_error if the name is unknown.
+ */
+bitmap_layout bitmap_layout_from_name(const string& name)
+{
+    if(name == "rgb")
+        return bitmap_layout::rgb;
+
+    if(name == "bgr")
+        return bitmap_layout::bgr;
+
+    throw logic_error("unknown channel order: " + name + ", expected rgb or bgr");
+}
+
+typedef void (*convert_row_function)(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool flag);
+
+/*!
+ * \brief Convert the pixels of a row from first to width to grayscale, the scalar tail of all kernels.
+ */
+static void gray_scalar(const uint8_t* src, uint8_t* dst, size_t first, size_t width, size_t pixel_step, bool red_first)
+{
+    const size_t red = red_first ? 0 : 2;
+    const size_t blue = red_first ? 2 : 0;
+
+    for(size_t x = first; x < width; x++)
+    {
+        const uint8_t* pixel = src + x * pixel_step;
+        dst[x] = static_cast<uint8_t>(0.2126F * pixel[red] + 0.7152F * pixel[1] + 0.0722F * pixel[blue] + 0.5F);
+    }
+}
+
+/*!
+ * \brief Copy the pixels of a row from first to width to 24-bit pixels, the scalar tail of all kernels.
+ */
+static void color_scalar(const uint8_t* src, uint8_t* dst, size_t first, size_t width, size_t pixel_step, bool swap_red_blue)
+{
+    const size_t first_byte = swap_red_blue ? 2 : 0;
+    const size_t third_byte = swap_red_blue ? 0 : 2;
+
+    for(size_t x = first; x < width; x++)
+    {
+        const uint8_t* pixel = src + x * pixel_step;
+        dst[3 * x] = pixel[first_byte];
+        dst[3 * x + 1] = pixel[1];
+        dst[3 * x + 2] = pixel[third_byte];
+    }
+}
+
+static void gray_row_scalar(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool red_first)
+{
+    gray_scalar(src, dst, 0, width, pixel_step, red_first);
+}
+
+static void color_row_scalar(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool swap_red_blue)
+{
+    color_scalar(src, dst, 0, width, pixel_step, swap_red_blue);
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+/*!
+ * \brief Build the shuffle that moves one byte of each of 4 pixels to the low byte of a 32-bit lane.
+ */
+static __m128i channel_shuffle(size_t pixel_step, size_t channel)
+{
+    alignas(16) int8_t mask[16];
+
+    for(size_t i = 0; i < 16; i++)
+        mask[i] = (i % 4 == 0) ? static_cast<int8_t>(i / 4 * pixel_step + channel) : -1;
+
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+/*!
+ * \brief Build the shuffle that packs 4 pixels to 12 bytes of 24-bit pixels, the last 4 bytes are zeroed.
+ */
+static __m128i color_shuffle(size_t pixel_step, bool swap_red_blue)
+{
+    alignas(16) int8_t mask[16];
+
+    for(size_t i = 0; i < 16; i++)
+    {
+        size_t channel = i % 3;
+        if(swap_red_blue && channel != 1)
+            channel = 2 - channel;
+
+        mask[i] = i < 12 ? static_cast<int8_t>(i / 3 * pixel_step + channel) : -1;
+    }
+
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+// a vector step reads 16 bytes from the last of its pixels and writes 16 bytes at the last 3-byte output,
+// so the vector loops stop 6 pixels before the end of the row and leave the rest to the scalar tail
+
+__attribute__((target("ssse3")))
+static void gray_row_ssse3(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool red_first)
+{
+    const __m128i shuffle_red = channel_shuffle(pixel_step, red_first ? 0 : 2);
+    const __m128i shuffle_green = channel_shuffle(pixel_step, 1);
+    const __m128i shuffle_blue = channel_shuffle(pixel_step, red_first ? 2 : 0);
+    const __m128 weight_red = _mm_set1_ps(0.2126F);
+    const __m128 weight_green = _mm_set1_ps(0.7152F);
+    const __m128 weight_blue = _mm_set1_ps(0.0722F);
+    const __m128 half = _mm_set1_ps(0.5F);
+    const __m128i pack_bytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    size_t x = 0;
+    for(; x + 6 <= width; x += 4)
+    {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * pixel_step));
+
+        // the same operation order as the scalar code, so the rounding is the same
+        __m128 gray = _mm_add_ps(_mm_mul_ps(weight_red, _mm_cvtepi32_ps(_mm_shuffle_epi8(pixels, shuffle_red))),
+                                 _mm_mul_ps(weight_green, _mm_cvtepi32_ps(_mm_shuffle_epi8(pixels, shuffle_green))));
+        gray = _mm_add_ps(gray, _mm_mul_ps(weight_blue, _mm_cvtepi32_ps(_mm_shuffle_epi8(pixels, shuffle_blue))));
+        gray = _mm_add_ps(gray, half);
+
+        const int packed = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm_cvttps_epi32(gray), pack_bytes));
+        memcpy(dst + x, &packed, sizeof(packed));
+    }
+
+    gray_scalar(src, dst, x, width, pixel_step, red_first);
+}
+
+__attribute__((target("ssse3")))
+static void color_row_ssse3(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool swap_red_blue)
+{
+    if(pixel_step == 3 && !swap_red_blue)
+    {
+        memcpy(dst, src, 3 * width);
+        return;
+    }
+
+    const __m128i shuffle = color_shuffle(pixel_step, swap_red_blue);
+
+    size_t x = 0;
+    for(; x + 6 <= width; x += 4)
+    {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * pixel_step));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x), _mm_shuffle_epi8(pixels, shuffle));
+    }
+
+    color_scalar(src, dst, x, width, pixel_step, swap_red_blue);
+}
+
+__attribute__((target("avx2")))
+static void gray_row_avx2(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool red_first)
+{
+    const __m256i shuffle_red = _mm256_broadcastsi128_si256(channel_shuffle(pixel_step, red_first ? 0 : 2));
+    const __m256i shuffle_green = _mm256_broadcastsi128_si256(channel_shuffle(pixel_step, 1));
+    const __m256i shuffle_blue = _mm256_broadcastsi128_si256(channel_shuffle(pixel_step, red_first ? 2 : 0));
+    const __m256 weight_red = _mm256_set1_ps(0.2126F);
+    const __m256 weight_green = _mm256_set1_ps(0.7152F);
+    const __m256 weight_blue = _mm256_set1_ps(0.0722F);
+    const __m256 half = _mm256_set1_ps(0.5F);
+    const __m256i pack_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i pack_lanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    size_t x = 0;
+    for(; x + 10 <= width; x += 8)
+    {
+        // pixels 0-3 in the low lane, pixels 4-7 in the high lane
+        const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * pixel_step))),
+                                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + 4) * pixel_step)), 1);
+
+        __m256 gray = _mm256_add_ps(_mm256_mul_ps(weight_red, _mm256_cvtepi32_ps(_mm256_shuffle_epi8(pixels, shuffle_red))),
+                                    _mm256_mul_ps(weight_green, _mm256_cvtepi32_ps(_mm256_shuffle_epi8(pixels, shuffle_green))));
+        gray = _mm256_add_ps(gray, _mm256_mul_ps(weight_blue, _mm256_cvtepi32_ps(_mm256_shuffle_epi8(pixels, shuffle_blue))));
+        gray = _mm256_add_ps(gray, half);
+
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_cvttps_epi32(gray), pack_bytes), pack_lanes);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(packed));
+    }
+
+    gray_scalar(src, dst, x, width, pixel_step, red_first);
+}
+
+__attribute__((target("avx2")))
+static void color_row_avx2(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool swap_red_blue)
+{
+    if(pixel_step == 3 && !swap_red_blue)
+    {
+        memcpy(dst, src, 3 * width);
+        return;
+    }
+
+    const __m256i shuffle = _mm256_broadcastsi128_si256(color_shuffle(pixel_step, swap_red_blue));
+
+    size_t x = 0;
+    for(; x + 10 <= width; x += 8)
+    {
+        const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * pixel_step))),
+                                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + 4) * pixel_step)), 1);
+        const __m256i packed = _mm256_shuffle_epi8(pixels, shuffle);
+
+        // the high lane overwrites the 4 zero bytes of the low lane
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x + 12), _mm256_extracti128_si256(packed, 1));
+    }
+
+    color_scalar(src, dst, x, width, pixel_step, swap_red_blue);
+}
+
+#endif
+
+/*!
+ * \brief The conversion kernels selected once for the CPU the harness runs on.
+ */
+struct convert_kernels
+{
+    convert_row_function gray;
+    convert_row_function color;
+    const char* isa;
+
+    convert_kernels() : gray(gray_row_scalar), color(color_row_scalar), isa("scalar")
+    {
+#ifdef PIXEL_CONVERT_X86
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2"))
+        {
+            gray = gray_row_avx2;
+            color = color_row_avx2;
+            isa = "avx2";
+        }
+        else if(__builtin_cpu_supports("ssse3"))
+        {
+            gray = gray_row_ssse3;
+            color = color_row_ssse3;
+            isa = "ssse3";
+        }
+#endif
+    }
+};
+
+static const convert_kernels& get_kernels()
+{
+    static const convert_kernels kernels;
+    return kernels;
+}
+
+/*!
+ * \brief Convert a row of 24 or 32-bit pixels to 8-bit grayscale.
+ *
+ * Gray is 0.2126 R + 0.7152 G + 0.0722 B rounded, computed in single precision in the same order as
+ * FreeImage_ConvertToGreyscale(), so the vectorized kernels give the same bytes as FreeImage.
+ *
+ * \param src The source row.
+ * \param dst The destination row of width bytes.
+ * \param width The count of pixels.
+ * \param pixel_step The count of bytes per source pixel, 3 or 4.
+ * \param red_first Flag to indicate whether red is the first byte of a source pixel, otherwise blue is.
+ */
+void convert_row_to_gray(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool red_first)
+{
+    get_kernels().gray(src, dst, width, pixel_step, red_first);
+}
+
+/*!
+ * \brief Copy a row of 24 or 32-bit pixels to 24-bit pixels, swapping red and blue if requested.
+ *
+ * \param src The source row.
+ * \param dst The destination row of 3 * width bytes.
+ * \param width The count of pixels.
+ * \param pixel_step The count of bytes per source pixel, 3 or 4.
+ * \param swap_red_blue Flag to indicate whether to swap the first and the third byte of each pixel.
+ */
+void convert_row_to_color(const uint8_t* src, uint8_t* dst, size_t width, size_t pixel_step, bool swap_red_blue)
+{
+    get_kernels().color(src, dst, width, pixel_step, swap_red_blue);
+}
+
+/*!
+ * \brief Get the instruction set of the conversion kernels selected for this CPU.
+ *
+ * \return "avx2", "ssse3" or "scalar".
+ */
+const char* pixel_convert_isa()
+{
+    return get_kernels().isa;
+}
+
+/*!
+ * \brief Check the conversion kernels selected for this CPU against the scalar kernels.
+ *
+ * Rows of 1 to 80 pixels at unaligned offsets are converted with every pixel step and channel order,
+ * the kernels must give the same bytes.
+ *
+ * \throws logic_error on the first row the kernels differ.
+ */
+void pixel_convert_self_check()
+{
+    const convert_kernels& kernels = get_kernels();
+    const size_t max_width = 80;
+    const size_t max_offset = 3;
+
+    // fixed pseudo-random pixels, so a failure reproduces
+    vector<uint8_t> src(max_offset + 4 * max_width);
+    uint32_t state = 2463534242u;
+    for(uint8_t& value : src)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = static_cast<uint8_t>(state);
+    }
+
+    vector<uint8_t> expected(3 * max_width), actual(3 * max_width);
+
+    for(size_t pixel_step = 3; pixel_step <= 4; pixel_step++)
+        for(size_t offset = 0; offset <= max_offset; offset++)
+            for(size_t width = 1; width <= max_width; width++)
+                for(bool flag : {false, true})
+                {
+                    gray_row_scalar(src.data() + offset, expected.data(), width, pixel_step, flag);
+                    kernels.gray(src.data() + offset, actual.data(), width, pixel_step, flag);
+
+                    if(memcmp(expected.data(), actual.data(), width))
+                        throw logic_error(string("pixel conversion self-check failed: ") + kernels.isa + " gray kernel, " + to_string(width) + " pixels of "
+                                          + to_string(pixel_step) + " bytes at offset " + to_string(offset));
+
+                    color_row_scalar(src.data() + offset, expected.data(), width, pixel_step, flag);
+                    kernels.color(src.data() + offset, actual.data(), width, pixel_step, flag);
+
+                    if(memcmp(expected.data(), actual.data(), 3 * width))
+                        throw logic_error(string("pixel conversion self-check failed: ") + kernels.isa + " color kernel, " + to_string(width) + " pixels of "
+                                          + to_string(pixel_step) + " bytes at offset " + to_string(offset));
+                }
+}
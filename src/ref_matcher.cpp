@@ -0,0 +1,709 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REF_MATCHER_X86
+#endif
+
+#include "ref_matcher.h"
+
+/*!
+ * \brief Get the name of an element type.
+ *
+ * \param element The element type.
+ *
+ * \return "float32", "float16" or "int8".
+ */
+const char* ref_element_name(ref_element element)
+{
+    switch(element)
+    {
+    case ref_element::float32:
+        return "float32";
+    case ref_element::float16:
+        return "float16";
+    default:
+        return "int8";
+    }
+}
+
+/*!
+ * \brief Get the name of a metric.
+ *
+ * \param metric The metric.
+ *
+ * \return "dot", "cosine" or "l2".
+ */
+const char* ref_metric_name(ref_metric metric)
+{
+    switch(metric)
+    {
+    case ref_metric::dot:
+        return "dot";
+    case ref_metric::cosine:
+        return "cosine";
+    default:
+        return "l2";
+    }
+}
+
+/*!
+ * \brief Get the size of an element type.
+ *
+ * \param element The element type.
+ *
+ * \return The size of one element in bytes.
+ */
+size_t ref_element_size(ref_element element)
+{
+    switch(element)
+    {
+    case ref_element::float32:
+        return 4;
+    case ref_element::float16:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// the vectors sit at any offset of packed templates, so all kernels load them unaligned
+
+static float load_float32(const uint8_t* src)
+{
+    float value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static float load_float16(const uint8_t* src)
+{
+    uint16_t half;
+    memcpy(&half, src, sizeof(half));
+
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+
+    if(exponent == 0)
+    {
+        // zero or subnormal, mantissa * 2^-24
+        const float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+
+    const uint32_t bits = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static float dot_float32_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    float sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+        sum += load_float32(a + 4 * k) * load_float32(b + 4 * k);
+
+    return sum;
+}
+
+static float dot_float16_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    float sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+        sum += load_float16(a + 2 * k) * load_float16(b + 2 * k);
+
+    return sum;
+}
+
+static float dot_int8_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    int64_t sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+        sum += int(int8_t(a[k])) * int(int8_t(b[k]));
+
+    return static_cast<float>(sum);
+}
+
+static float l2_float32_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    float sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+    {
+        const float diff = load_float32(a + 4 * k) - load_float32(b + 4 * k);
+        sum += diff * diff;
+    }
+
+    return sum;
+}
+
+static float l2_float16_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    float sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+    {
+        const float diff = load_float16(a + 2 * k) - load_float16(b + 2 * k);
+        sum += diff * diff;
+    }
+
+    return sum;
+}
+
+static float l2_int8_scalar(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    int64_t sum = 0;
+    for(size_t k = 0; k < dimension; k++)
+    {
+        const int diff = int(int8_t(a[k])) - int(int8_t(b[k]));
+        sum += diff * diff;
+    }
+
+    return static_cast<float>(sum);
+}
+
+#ifdef REF_MATCHER_X86
+
+// __builtin_cpu_supports knows F16C since GCC 11, older compilers rely on every CPU with AVX2 and FMA having it
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#define REF_MATCHER_CPU_F16C __builtin_cpu_supports("f16c")
+#else
+#define REF_MATCHER_CPU_F16C 1
+#endif
+
+__attribute__((target("avx2,fma,f16c")))
+static float sum_avx2(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static int sum_avx2(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float dot_float32_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    // two accumulators hide the latency of the fused multiply-add
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k + 8), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k + 8), sum1);
+    }
+
+    for(; k + 8 <= dimension; k += 8)
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k), sum0);
+
+    return sum_avx2(_mm256_add_ps(sum0, sum1)) + dot_float32_scalar(a + 4 * k, b + 4 * k, dimension - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float dot_float16_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m256 sum = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 8 <= dimension; k += 8)
+    {
+        const __m256 va = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * k)));
+        const __m256 vb = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * k)));
+        sum = _mm256_fmadd_ps(va, vb, sum);
+    }
+
+    return sum_avx2(sum) + dot_float16_scalar(a + 2 * k, b + 2 * k, dimension - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float dot_int8_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    // products of 16-bit pairs are summed into 32-bit lanes, which hold 2 * 127 * 128 per step without overflow for any real dimension
+    __m256i sum = _mm256_setzero_si256();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)));
+        const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(va, vb));
+    }
+
+    return static_cast<float>(sum_avx2(sum)) + dot_int8_scalar(a + k, b + k, dimension - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float l2_float32_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k));
+        const __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k + 8), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k + 8));
+        sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+    }
+
+    for(; k + 8 <= dimension; k += 8)
+    {
+        const __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm256_loadu_ps(reinterpret_cast<const float*>(b) + k));
+        sum0 = _mm256_fmadd_ps(diff, diff, sum0);
+    }
+
+    return sum_avx2(_mm256_add_ps(sum0, sum1)) + l2_float32_scalar(a + 4 * k, b + 4 * k, dimension - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float l2_float16_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m256 sum = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 8 <= dimension; k += 8)
+    {
+        const __m256 va = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * k)));
+        const __m256 vb = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * k)));
+        const __m256 diff = _mm256_sub_ps(va, vb);
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+
+    return sum_avx2(sum) + l2_float16_scalar(a + 2 * k, b + 2 * k, dimension - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float l2_int8_avx2(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    // the differences fit 16 bits, their squares are summed in pairs into 32-bit lanes
+    __m256i sum = _mm256_setzero_si256();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)));
+        const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)));
+        const __m256i diff = _mm256_sub_epi16(va, vb);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+    }
+
+    return static_cast<float>(sum_avx2(sum)) + l2_int8_scalar(a + k, b + k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float dot_float32_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 32 <= dimension; k += 32)
+    {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k), sum0);
+        sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k + 16), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k + 16), sum1);
+    }
+
+    for(; k + 16 <= dimension; k += 16)
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k), sum0);
+
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) + dot_float32_scalar(a + 4 * k, b + 4 * k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float dot_float16_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512 sum = _mm512_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m512 va = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 2 * k)));
+        const __m512 vb = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * k)));
+        sum = _mm512_fmadd_ps(va, vb, sum);
+    }
+
+    return _mm512_reduce_add_ps(sum) + dot_float16_scalar(a + 2 * k, b + 2 * k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float dot_int8_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512i sum = _mm512_setzero_si512();
+
+    size_t k = 0;
+    for(; k + 32 <= dimension; k += 32)
+    {
+        const __m512i va = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)));
+        const __m512i vb = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(va, vb));
+    }
+
+    return static_cast<float>(_mm512_reduce_add_epi32(sum)) + dot_int8_scalar(a + k, b + k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float l2_float32_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 32 <= dimension; k += 32)
+    {
+        const __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k));
+        const __m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k + 16), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k + 16));
+        sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+    }
+
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(reinterpret_cast<const float*>(a) + k), _mm512_loadu_ps(reinterpret_cast<const float*>(b) + k));
+        sum0 = _mm512_fmadd_ps(diff, diff, sum0);
+    }
+
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) + l2_float32_scalar(a + 4 * k, b + 4 * k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float l2_float16_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512 sum = _mm512_setzero_ps();
+
+    size_t k = 0;
+    for(; k + 16 <= dimension; k += 16)
+    {
+        const __m512 va = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 2 * k)));
+        const __m512 vb = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * k)));
+        const __m512 diff = _mm512_sub_ps(va, vb);
+        sum = _mm512_fmadd_ps(diff, diff, sum);
+    }
+
+    return _mm512_reduce_add_ps(sum) + l2_float16_scalar(a + 2 * k, b + 2 * k, dimension - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static float l2_int8_avx512(const uint8_t* a, const uint8_t* b, size_t dimension)
+{
+    __m512i sum = _mm512_setzero_si512();
+
+    size_t k = 0;
+    for(; k + 32 <= dimension; k += 32)
+    {
+        const __m512i va = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)));
+        const __m512i vb = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+        const __m512i diff = _mm512_sub_epi16(va, vb);
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(diff, diff));
+    }
+
+    return static_cast<float>(_mm512_reduce_add_epi32(sum)) + l2_int8_scalar(a + k, b + k, dimension - k);
+}
+
+#endif
+
+typedef float (*match_kernel_function)(const uint8_t* a, const uint8_t* b, size_t dimension);
+
+/*!
+ * \brief The match kernels selected once for the CPU the harness runs on, indexed by the element type.
+ */
+struct match_kernels
+{
+    match_kernel_function dot[3];
+    match_kernel_function l2[3];
+    const char* isa;
+
+    explicit match_kernels(bool dispatch_flag = true) :
+        dot{dot_float32_scalar, dot_float16_scalar, dot_int8_scalar},
+        l2{l2_float32_scalar, l2_float16_scalar, l2_int8_scalar},
+        isa("scalar")
+    {
+#ifdef REF_MATCHER_X86
+        if(!dispatch_flag)
+            return;
+
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        {
+            dot[0] = dot_float32_avx512;
+            dot[1] = dot_float16_avx512;
+            dot[2] = dot_int8_avx512;
+            l2[0] = l2_float32_avx512;
+            l2[1] = l2_float16_avx512;
+            l2[2] = l2_int8_avx512;
+            isa = "avx512";
+        }
+        else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && REF_MATCHER_CPU_F16C)
+        {
+            dot[0] = dot_float32_avx2;
+            dot[1] = dot_float16_avx2;
+            dot[2] = dot_int8_avx2;
+            l2[0] = l2_float32_avx2;
+            l2[1] = l2_float16_avx2;
+            l2[2] = l2_int8_avx2;
+            isa = "avx2";
+        }
+#endif
+    }
+};
+
+static const match_kernels& get_kernels()
+{
+    static const match_kernels kernels;
+    return kernels;
+}
+
+static size_t element_index(ref_element element)
+{
+    switch(element)
+    {
+    case ref_element::float32:
+        return 0;
+    case ref_element::float16:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+/*!
+ * \brief Create a matcher of a descriptor set, checking the size of its templates.
+ *
+ * \param descriptors The descriptor set, it must outlive the matcher.
+ * \param element The element type of the vectors.
+ * \param metric The metric to compare the vectors with.
+ * \param offset The offset of the vector from the beginning of a template in bytes.
+ * \param dimension The count of elements of the vector.
+ */
+ref_matcher::ref_matcher(const desc_set& descriptors, ref_element element, ref_metric metric, size_t offset, size_t dimension)
+    : m_descriptors(descriptors), m_metric(metric), m_offset(offset), m_dimension(dimension), m_template_size(offset + dimension * ref_element_size(element))
+{
+    if(!dimension)
+        throw logic_error("the dimension of the template layout must be greater than 0");
+
+    const match_kernels& kernels = get_kernels();
+    m_kernel = metric == ref_metric::l2 ? kernels.l2[element_index(element)] : kernels.dot[element_index(element)];
+
+    // refused templates are never matched, all others must hold the whole vector
+    for(size_t i = 0; i < descriptors.size(); i++)
+        if(descriptors.label(i) > 0 && descriptors.row_size(i) < m_template_size)
+            throw runtime_error("template " + to_string(i) + " is " + to_string(descriptors.row_size(i)) + " bytes, the template layout needs " + to_string(m_template_size));
+
+    if(metric == ref_metric::cosine)
+    {
+        m_inv_norms.assign(descriptors.size(), 0);
+
+        for(size_t i = 0; i < descriptors.size(); i++)
+        {
+            if(descriptors.label(i) <= 0)
+                continue;
+
+            const uint8_t* vector_i = descriptors.row(i) + offset;
+            const float norm = sqrt(m_kernel(vector_i, vector_i, dimension));
+
+            // a zero vector has no direction, its similarity to anything is 0
+            m_inv_norms[i] = norm > 0 ? 1 / norm : 0;
+        }
+    }
+}
+
+/*!
+ * \brief Match a descriptor against several descriptors of the set.
+ *
+ * \param row The index of the descriptor.
+ * \param columns The indexes of the descriptors to compare it with.
+ * \param similarities Reference to store the similarity to each of columns.
+ */
+void ref_matcher::match_batch(size_t row, const vector<size_t>& columns, vector<double>& similarities) const
+{
+    similarities.resize(columns.size());
+
+    const uint8_t* vector_row = m_descriptors.row(row) + m_offset;
+
+    for(size_t k = 0; k < columns.size(); k++)
+    {
+        const size_t column = columns[k];
+        const float value = m_kernel(vector_row, m_descriptors.row(column) + m_offset, m_dimension);
+
+        switch(m_metric)
+        {
+        case ref_metric::dot:
+            similarities[k] = value;
+            break;
+        case ref_metric::cosine:
+            similarities[k] = value * m_inv_norms[row] * m_inv_norms[column];
+            break;
+        default:
+            similarities[k] = 1 / (1 + sqrt(value));
+            break;
+        }
+    }
+}
+
+/*!
+ * \brief Get the template size the layout needs.
+ *
+ * \return The offset plus the size of the vector in bytes.
+ */
+size_t ref_matcher::template_size() const
+{
+    return m_template_size;
+}
+
+/*!
+ * \brief Get the instruction set of the match kernels selected for this CPU.
+ *
+ * \return "avx512", "avx2" or "scalar".
+ */
+const char* ref_matcher_isa()
+{
+    return get_kernels().isa;
+}
+
+/*!
+ * \brief Compare a kernel result with the scalar one, the vector kernels add the products in another order.
+ *
+ * \param expected The scalar result.
+ * \param actual The result of the selected kernel.
+ * \param magnitude The sum of the absolute values of the added terms.
+ *
+ * \return 'true' if the results agree.
+ */
+static bool same_kernel_result(float expected, float actual, double magnitude)
+{
+    if(expected == actual)
+        return true;
+
+    if(std::isnan(expected) || std::isnan(actual))
+        return std::isnan(expected) && std::isnan(actual);
+
+    return fabs(double(expected) - double(actual)) <= 1e-4 * magnitude;
+}
+
+/*!
+ * \brief Check the match kernels selected for this CPU against the scalar kernels.
+ *
+ * Every element type and kernel is run for dimensions 1 to 513 at offsets 0, 1 and 3, with int8 extremes
+ * and with each of the 65536 float16 values, the kernels must agree up to the float rounding of the sums.
+ *
+ * \throws logic_error on the first case the kernels differ.
+ */
+void ref_matcher_self_check()
+{
+    const match_kernels& kernels = get_kernels();
+    const match_kernels scalar_kernels(false);
+    const size_t max_dimension = 513;
+    const size_t offsets[] = {0, 1, 3};
+
+    // fixed pseudo-random vectors, so a failure reproduces
+    uint32_t state = 2463534242u;
+    auto next_random = [&state]()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    // the elements of a vector at an offset, float32 in [-1, 1], finite float16 of any sign, exponent and mantissa, any int8
+    auto fill = [&](size_t index, size_t offset, vector<uint8_t>& buffer)
+    {
+        buffer.assign(offset + 4 * max_dimension, 0);
+
+        for(size_t k = 0; k < max_dimension; k++)
+        {
+            const uint32_t random = next_random();
+
+            if(index == 0)
+            {
+                const float value = int(random % 2001) / 1000.0f - 1;
+                memcpy(&buffer[offset + 4 * k], &value, sizeof(float));
+            }
+            else if(index == 1)
+            {
+                const uint16_t half = static_cast<uint16_t>((random & 0x83ff) | ((random >> 16) % 0x1f) << 10);
+                memcpy(&buffer[offset + 2 * k], &half, sizeof(uint16_t));
+            }
+            else
+                buffer[offset + k] = static_cast<uint8_t>(random);
+        }
+    };
+
+    vector<uint8_t> a, b;
+
+    auto check = [&](size_t index, bool l2_flag, const uint8_t* vector_a, const uint8_t* vector_b, size_t dimension, size_t offset)
+    {
+        const match_kernel_function kernel = l2_flag ? kernels.l2[index] : kernels.dot[index];
+        const match_kernel_function scalar_kernel = l2_flag ? scalar_kernels.l2[index] : scalar_kernels.dot[index];
+
+        // the magnitude of the sum is the scalar kernel run on the absolute values
+        double magnitude = 0;
+        for(size_t k = 0; k < dimension; k++)
+        {
+            const uint8_t* element_a = vector_a + k * (index == 0 ? 4 : index == 1 ? 2 : 1);
+            const uint8_t* element_b = vector_b + k * (index == 0 ? 4 : index == 1 ? 2 : 1);
+            const double value_a = index == 0 ? load_float32(element_a) : index == 1 ? load_float16(element_a) : int8_t(*element_a);
+            const double value_b = index == 0 ? load_float32(element_b) : index == 1 ? load_float16(element_b) : int8_t(*element_b);
+            magnitude += l2_flag ? (value_a - value_b) * (value_a - value_b) : fabs(value_a * value_b);
+        }
+
+        // the int8 kernels sum integers, they must be exact
+        const float expected = scalar_kernel(vector_a, vector_b, dimension);
+        const float actual = kernel(vector_a, vector_b, dimension);
+
+        if(index == 2 ? expected != actual : !same_kernel_result(expected, actual, magnitude))
+            throw logic_error(string("reference matcher self-check failed: ") + kernels.isa + " " + (l2_flag ? "l2" : "dot") + " " + ref_element_name(static_cast<ref_element>(index))
+                              + " kernel, dimension " + to_string(dimension) + " at offset " + to_string(offset) + ": " + to_string(actual) + " instead of " + to_string(expected));
+    };
+
+    for(size_t index = 0; index < 3; index++)
+        for(size_t offset : offsets)
+        {
+            fill(index, offset, a);
+            fill(index, offset, b);
+
+            for(bool l2_flag : {false, true})
+                for(size_t dimension = 1; dimension <= max_dimension; dimension++)
+                    check(index, l2_flag, a.data() + offset, b.data() + offset, dimension, offset);
+        }
+
+    // int8 extremes, the largest products and differences the 16-bit multiply-add takes
+    vector<uint8_t> min_int8(max_dimension, 0x80), max_int8(max_dimension, 0x7f);
+    check(2, false, min_int8.data(), min_int8.data(), max_dimension, 0);
+    check(2, true, min_int8.data(), max_int8.data(), max_dimension, 0);
+
+    // every float16 value, alone in a vector summed against ones, goes through the conversion of the kernel unchanged
+    const uint16_t half_one = 0x3c00;
+    const size_t half_dimension = 32;
+    vector<uint16_t> halves(half_dimension, 0), ones(half_dimension, half_one);
+
+    for(uint32_t half = 0; half <= 0xffff; half++)
+    {
+        const size_t position = half % half_dimension;
+        halves[position] = static_cast<uint16_t>(half);
+
+        const float expected = load_float16(reinterpret_cast<const uint8_t*>(&halves[position]));
+        const float actual = kernels.dot[1](reinterpret_cast<const uint8_t*>(halves.data()), reinterpret_cast<const uint8_t*>(ones.data()), half_dimension);
+
+        if(!(expected == actual || (std::isnan(expected) && std::isnan(actual))))
+            throw logic_error(string("reference matcher self-check failed: ") + kernels.isa + " float16 conversion of " + to_string(half) + ": " + to_string(actual) + " instead of " + to_string(expected));
+
+        halves[position] = 0;
+    }
+}
@@ -41,6 +41,20 @@ nanoseconds timing::stop()
     return interval;
 }
 
+/*!
+ * \brief Add the intervals measured by another timer, as if they were measured by this one.
+ *
+ * \param other The timer to take the intervals from.
+ */
+void timing::merge(const timing& other)
+{
+    m_acc += other.m_acc;
+    m_call_counter += other.m_call_counter;
+
+    if(m_extended)
+        m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+}
+
 /*!
  * \brief Calculates the average time interval over multiple start-stop cycles.
  *
@@ -1,6 +1,8 @@
 #include <sys/wait.h>
 
+#include <atomic>
 #include <fstream>
+#include <algorithm>
 
 #include <FreeImage.h>
 
@@ -122,54 +124,148 @@ string get_abs(shared_ptr<TCLAP::Arg> arg, params_type& params)
     return relative_to_abs(get_param<string>(arg), params);
 }
 
+/*!
+ * \brief Get the FreeImage size hint to decode a JPEG image at the smallest DCT scale (1/2, 1/4, 1/8) that keeps it at least max_width x max_height.
+ *
+ * \param file_memory The JPEG image in memory.
+ * \param max_width The width the engine makes use of (0 - no limit).
+ * \param max_height The height the engine makes use of (0 - no limit).
+ *
+ * \return The size hint flags for FreeImage_LoadFromMemory, 0 to decode at full resolution.
+ */
+static int jpeg_size_hint(FIMEMORY* file_memory, size_t max_width, size_t max_height)
+{
+    if(!max_width && !max_height)
+        return 0;
+
+    FIBITMAP* fibitmap_header = FreeImage_LoadFromMemory(FIF_JPEG, file_memory, FIF_LOAD_NOPIXELS);
+    FreeImage_SeekMemory(file_memory, 0, SEEK_SET);
+
+    if(fibitmap_header == nullptr)
+        return 0;
+
+    const size_t width = FreeImage_GetWidth(fibitmap_header);
+    const size_t height = FreeImage_GetHeight(fibitmap_header);
+
+    FreeImage_Unload(fibitmap_header);
+
+    for(size_t scale = 8; scale > 1; scale /= 2)
+        if(width / scale >= max_width && height / scale >= max_height)
+        {
+            // FreeImage decodes at 1/denominator with the denominator the larger side divided by the hint in integers,
+            // rounded down to 1, 2, 4 or 8, so the hint is the larger side at the scale divided the same way
+            const size_t size = max(width, height) / scale;
+            return static_cast<int>(size << 16);
+        }
+
+    return 0;
+}
+
 /*!
  * \brief Load and extract bitmap data from an image file.
  *
  * \param file The file path of the image to load.
- * \param gray_flag Flag to indicate whether to convert the image to grayscale.
+ * \param layout The pixel layout of the bitmap: RGB, BGR or grayscale.
  * \param width Reference to store the width of the loaded bitmap.
  * \param height Reference to store the height of the loaded bitmap.
+ * \param max_width The width the engine makes use of, JPEG images are decoded at a reduced scale down to it (0 - no limit).
+ * \param max_height The height the engine makes use of, JPEG images are decoded at a reduced scale down to it (0 - no limit).
+ * \param pool The pool to take the bitmap buffer from, nullptr to allocate it.
+ * \param timings The timings to add the time of the read, decode and convert stages to, nullptr to skip timing.
  *
- * \return A shared_ptr to the loaded bitmap data as an array of uint8_t.
+ * \return A shared_ptr to the loaded bitmap data as an array of uint8_t, rows top-down without padding.
  */
-shared_ptr<uint8_t> get_bitmap(const string& file, bool gray_flag, size_t& width, size_t& height)
+shared_ptr<uint8_t> get_bitmap(const string& file, bitmap_layout layout, size_t& width, size_t& height, size_t max_width, size_t max_height, bitmap_pool* pool, bitmap_timings* timings)
 {
-    FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
-    fif = FreeImage_GetFileType(file.c_str());
+    auto tstart = high_resolution_clock::now();
+
+    // the file is read separately from decoding, so the read time can be told from the decode time
+    static thread_local vector<BYTE> file_data;
+    {
+        ifstream file_stream(file, ifstream::binary | ifstream::ate);
+
+        if(!file_stream.is_open())
+            throw runtime_error("FreeImage: failed to open image " + file);
+
+        file_data.resize(static_cast<size_t>(file_stream.tellg()));
+        file_stream.seekg(0);
+
+        if(!file_stream.read(reinterpret_cast<char*>(file_data.data()), static_cast<streamsize>(file_data.size())))
+            throw runtime_error("failed to read image " + file);
+    }
+
+    auto tdecode = high_resolution_clock::now();
+
+    FIMEMORY* file_memory = FreeImage_OpenMemory(file_data.data(), static_cast<DWORD>(file_data.size()));
+
+    FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromMemory(file_memory, 0);
     int flags = 0;
     if(fif == FIF_JPEG)
-        flags = JPEG_ACCURATE;
+        flags = JPEG_ACCURATE | jpeg_size_hint(file_memory, max_width, max_height);
 
-    FIBITMAP* fibitmap  = FreeImage_Load(fif, file.c_str(), flags);
+    FIBITMAP* fibitmap = FreeImage_LoadFromMemory(fif, file_memory, flags);
+    FreeImage_CloseMemory(file_memory);
 
     if(fibitmap == nullptr)
-    {
-        FreeImage_DeInitialise();
         throw runtime_error("FreeImage: failed to open image " + file);
-    }
 
-    size_t channels = 0;
-    if(gray_flag)
+    auto tconvert = high_resolution_clock::now();
+
+    const bool gray_flag = layout == bitmap_layout::gray;
+    size_t bpp = FreeImage_GetBPP(fibitmap);
+    const bool rgb_bitmap = FreeImage_GetImageType(fibitmap) == FIT_BITMAP && (bpp == 24 || bpp == 32);
+    const bool gray_bitmap = FreeImage_GetImageType(fibitmap) == FIT_BITMAP && bpp == 8 && FreeImage_GetColorType(fibitmap) == FIC_MINISBLACK;
+
+    // other formats are converted by FreeImage first, 24 and 32 bit rasters are converted while copying
+    if(!rgb_bitmap && !(gray_flag && gray_bitmap))
     {
-        FIBITMAP* fibitmap_gray = FreeImage_ConvertToGreyscale(fibitmap);
+        FIBITMAP* fibitmap_converted = gray_flag ? FreeImage_ConvertToGreyscale(fibitmap) : FreeImage_ConvertTo24Bits(fibitmap);
         FreeImage_Unload(fibitmap);
-        fibitmap = fibitmap_gray;
-        channels = 1;
+        fibitmap = fibitmap_converted;
+
+        if(fibitmap == nullptr)
+            throw runtime_error("FreeImage: failed to convert image " + file);
+
+        bpp = FreeImage_GetBPP(fibitmap);
     }
-    else
-        channels = 3;
 
-    FreeImage_FlipVertical(fibitmap);
+    const size_t channels = bitmap_layout_channels(layout);
+    const size_t pixel_step = bpp / 8;
+    const bool red_first = FreeImage_GetRedMask(fibitmap) == 0xFF;
+    const bool swap_red_blue = red_first != (layout == bitmap_layout::rgb);
 
     width = FreeImage_GetWidth(fibitmap);
     height = FreeImage_GetHeight(fibitmap);
-    size_t bitmap_size = width * height * channels;
+    const size_t row_size = width * channels;
+    const size_t bitmap_size = row_size * height;
 
-    shared_ptr<uint8_t> data(new uint8_t[bitmap_size], default_delete<uint8_t[]>());
-    memcpy(data.get(), FreeImage_GetBits(fibitmap), bitmap_size * sizeof(uint8_t));
+    shared_ptr<uint8_t> data = pool ? pool->get(bitmap_size) : shared_ptr<uint8_t>(new uint8_t[bitmap_size], default_delete<uint8_t[]>());
+
+    // FreeImage keeps rows bottom-up and padded to the pitch
+    for(size_t y = 0; y < height; y++)
+    {
+        const uint8_t* src = FreeImage_GetScanLine(fibitmap, static_cast<int>(height - 1 - y));
+        uint8_t* dst = data.get() + y * row_size;
+
+        if(gray_flag && pixel_step == 1)
+            memcpy(dst, src, row_size);
+        else if(gray_flag)
+            convert_row_to_gray(src, dst, width, pixel_step, red_first);
+        else
+            convert_row_to_color(src, dst, width, pixel_step, swap_red_blue);
+    }
 
     FreeImage_Unload(fibitmap);
 
+    if(timings)
+    {
+        const auto tstop = high_resolution_clock::now();
+
+        timings->read += tdecode - tstart;
+        timings->decode += tconvert - tdecode;
+        timings->convert += tstop - tconvert;
+    }
+
     return data;
 }
 
@@ -203,6 +299,164 @@ void wait_all_forks()
     }
 }
 
+/*!
+ * \brief Join all worker threads and check for errors.
+ *
+ * \param workers The worker threads to join.
+ * \param errors The exceptions captured by the workers, indexed by worker index (empty if the worker succeeded).
+ * \param stage The name of the stage the workers run, used in the error message.
+ */
+void wait_all_threads(vector<thread>& workers, const vector<exception_ptr>& errors, const string& stage)
+{
+    for(auto& worker : workers)
+        worker.join();
+
+    stringstream err_str;
+    bool err_flag = false;
+    for(size_t i = 0; i < errors.size(); i++)
+    {
+        if(!errors[i])
+            continue;
+
+        err_str << (err_flag ? "; " : "Errors in worker threads on " + stage + " stage, Err workers: ") << i << " - ";
+        err_flag = true;
+
+        try
+        {
+            rethrow_exception(errors[i]);
+        }
+        catch(const exception& e)
+        {
+            err_str << e.what();
+        }
+        catch(...)
+        {
+            err_str << "unknown error";
+        }
+    }
+
+    if(err_flag)
+        throw runtime_error(err_str.str());
+}
+
+/*!
+ * \brief Check the extract mode parameter value.
+ *
+ * \param mode The extract mode: "fork" or "threads".
+ *
+ * \return 'true' if extract workers should run as threads in one process, 'false' if they should be forked.
+ *
+ * \throws logic_error if the extract mode is unknown.
+ */
+bool extract_mode_is_threads(const string& mode)
+{
+    if(mode == "threads")
+        return true;
+
+    if(mode != "fork")
+        throw logic_error("unknown extract_mode: " + mode + ", expected fork or threads");
+
+    return false;
+}
+
+/*!
+ * \brief Read files once so later reads are served from the page cache.
+ *
+ * \param files The file paths, missing files are skipped.
+ */
+void read_to_page_cache(const vector<string>& files)
+{
+    vector<char> buf(1 << 16);
+
+    for(const string& file : files)
+    {
+        ifstream file_stream(file, ifstream::binary);
+
+        while(file_stream.read(buf.data(), static_cast<streamsize>(buf.size())))
+            ;
+    }
+}
+
+/*!
+ * \brief Read the dimensions of images from their headers, without decoding the pixels.
+ *
+ * \param files The file paths of the images.
+ * \param count_threads The count of threads reading the headers.
+ *
+ * \return The count of pixels of each image, 0 for images whose header can not be read.
+ */
+vector<uint64_t> read_image_pixels(const vector<string>& files, uint count_threads)
+{
+    vector<uint64_t> pixels(files.size(), 0);
+    atomic<size_t> next_file(0);
+
+    auto read_headers = [&]()
+    {
+        for(size_t i = next_file++; i < files.size(); i = next_file++)
+        {
+            FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(files[i].c_str());
+
+            if(fif == FIF_UNKNOWN)
+                continue;
+
+            FIBITMAP* fibitmap_header = FreeImage_Load(fif, files[i].c_str(), FIF_LOAD_NOPIXELS);
+
+            if(fibitmap_header == nullptr)
+                continue;
+
+            pixels[i] = static_cast<uint64_t>(FreeImage_GetWidth(fibitmap_header)) * FreeImage_GetHeight(fibitmap_header);
+            FreeImage_Unload(fibitmap_header);
+        }
+    };
+
+    vector<thread> workers;
+    for(uint i = 1; i < count_threads; i++)
+        workers.emplace_back(read_headers);
+
+    read_headers();
+
+    for(thread& worker : workers)
+        worker.join();
+
+    return pixels;
+}
+
+/*!
+ * \brief Log the throughput, speedup and parallel efficiency of a scaling sweep and choose the worker count.
+ *
+ * \param counts The worker counts of the sweep, the first one is the base of the speedup.
+ * \param throughputs The throughput of each worker count in templates per second.
+ *
+ * \return The smallest worker count within 5% of the best throughput.
+ */
+uint log_scaling_sweep(const vector<uint>& counts, const vector<double>& throughputs)
+{
+    if(counts.empty() || counts.size() != throughputs.size())
+        throw logic_error("scaling sweep has no results");
+
+    const double best_throughput = *max_element(throughputs.begin(), throughputs.end());
+
+    uint best_count = counts.back();
+    for(size_t i = counts.size(); i-- > 0; )
+        if(throughputs[i] >= 0.95 * best_throughput)
+            best_count = counts[i];
+
+    LOG(INFO) << "scaling sweep results:";
+    for(size_t i = 0; i < counts.size(); i++)
+    {
+        const double speedup = throughputs[i] / throughputs[0];
+        const double efficiency = speedup * counts[0] / counts[i];
+
+        LOG(INFO) << "    " << counts[i] << " workers - " << to_string_form(throughputs[i], 2) << " templates/s, speedup "
+                  << to_string_form(speedup, 2) << ", efficiency " << to_string_form(100 * efficiency, 1) << "%"
+                  << (counts[i] == best_count ? " <- best" : "");
+    }
+
+    LOG(INFO) << "scaling sweep: best count proc - " << best_count;
+
+    return best_count;
+}
+
 /*!
  * \brief Extract the filename from a given file path.
  *
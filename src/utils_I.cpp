@@ -29,10 +29,26 @@ params_type parse_cmd_line(int argc, char* argv[])
     params["extract_prefix"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "extract_prefix", "path to images directory", false, "input/images", "string"));
     params["grayscale"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "grayscale", "open images as grayscale", false, false, "bool"));
     params["count_proc"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "count_proc", "count extract processes", false, thread::hardware_concurrency(), "unsigned int"));
+    params["extract_mode"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "extract_mode", "extract workers mode: fork - separate processes, threads - threads in one process (requires thread-safe createTemplate)", false, "fork", "string"));
+    params["extract_chunk"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "extract_chunk", "count templates handed out to an extract worker at once", false, 16, "unsigned int"));
+    params["decode_threads"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "decode_threads", "count image decode threads per extract worker, 0 - decode in the extract worker", false, 0, "unsigned int"));
+    params["decode_queue"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "decode_queue", "count decoded templates queued per extract worker", false, 8, "unsigned int"));
+    params["write_batch"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "write_batch", "count descriptors an extract worker keeps in memory before writing them to the output files", false, 1000, "unsigned int"));
+    params["extract_batch"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "extract_batch", "count templates passed to createTemplateBatch at once", false, 1, "unsigned int"));
+    params["resume"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "resume", "continue an interrupted extract stage from its journal instead of starting over", false, false, "bool"));
+    params["image_cache"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "image_cache", "keep decoded images in output/image_cache and reuse them in later runs", false, false, "bool"));
+    params["image_pack"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "image_pack", "path to a pack of pre-decoded images built by checkFaceApi_pack, used instead of the image files, empty - decode the image files", false, "", "string"));
+    params["reduced_decode"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "reduced_decode", "decode JPEG images at a reduced scale down to the input size the engine declares", false, false, "bool"));
+    params["pin_cpus"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "pin_cpus", "pin extract workers: none, cpu - one cpu per worker spread over NUMA nodes, node - all cpus of one NUMA node per worker", false, "none", "string"));
+    params["bind_memory"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "bind_memory", "bind memory of pinned extract workers to their NUMA node", false, false, "bool"));
+    params["scaling_sweep"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "scaling_sweep", "extract a sample at 1, 2, 4 ... count_proc workers before the extract stage: none, report - log the speedup, apply - also run the extract stage with the best count", false, "none", "string"));
+    params["scaling_sweep_sample"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "scaling_sweep_sample", "count templates extracted at each step of the scaling sweep", false, 200, "unsigned int"));
+    params["progress_interval"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "progress_interval", "interval of the extract progress report in seconds, 0 - report only the summary", false, 10, "unsigned int"));
+    params["cost_order"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "cost_order", "read image headers before extract and hand out the most expensive templates first", false, false, "bool"));
     params["extra_timings"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "extra_timings", "print extra timings: percentile, min, max, std_dev", false, false, "bool"));
     params["extract_info"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "extract_info", "logging additional extract results: eyes, quality, etc", false, false, "bool"));
     params["debug_info"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "debug_info", "logging debug output", false, false, "bool"));
-    params["desc_size"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "desc_size", "descriptor size", false, 512, "unsigned int"));
+    params["desc_size"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "desc_size", "maximum descriptor size the extract stage accepts, each descriptor is stored with its own size", false, 512, "unsigned int"));
     params["percentile"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "percentile", "percentile in %", false, 90, "unsigned int"));
 
     params["nearest_count"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "nearest_count", "nearest count", false, 100, "unsigned int"));
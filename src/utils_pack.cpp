@@ -0,0 +1,47 @@
+#include <thread>
+
+#include "utils_pack.h"
+
+/*!
+ * \brief Parse command-line arguments and retrieve parameters.
+ *
+ * \param argc The number of command-line arguments.
+ * \param argv An array of character pointers containing the command-line arguments.
+ *
+ * \return A map of parameters with their associated command-line arguments.
+ */
+params_type parse_cmd_line(int argc, char* argv[])
+{
+    TCLAP::CmdLine cmd("checkFACEAPI Image Pack", '=');
+
+    params_type params;
+
+    params["split"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "split", "path to split directory", true, "", "string"));
+    params["lists"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "lists", "comma separated paths to extract list files", false, "input/extract.txt", "string"));
+    params["extract_prefix"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "extract_prefix", "path to images directory", false, "input/images", "string"));
+    params["image_pack"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "image_pack", "path to the image pack file to write", false, "input/images.pack", "string"));
+    params["grayscale"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<bool>("", "grayscale", "store images as grayscale", false, false, "bool"));
+    params["channel_order"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<string>("", "channel_order", "channel order of color images the engine declares: rgb or bgr", false, "bgr", "string"));
+    params["max_width"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "max_width", "decode JPEG images at a reduced scale down to this width, 0 - no limit", false, 0, "unsigned int"));
+    params["max_height"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "max_height", "decode JPEG images at a reduced scale down to this height, 0 - no limit", false, 0, "unsigned int"));
+    params["count_threads"] = shared_ptr<TCLAP::Arg>(new TCLAP::ValueArg<uint>("", "count_threads", "count decode threads", false, thread::hardware_concurrency(), "unsigned int"));
+
+    for(const auto& el : params)
+        cmd.add(*el.second);
+
+    cmd.parse(argc, argv);
+
+    return params;
+}
+
+/*!
+ * \brief Print all program information and options.
+ *
+ * \param params The map of parameters containing the program options.
+ */
+void print_all(params_type& params)
+{
+    LOG(INFO) << "commit: " << QUOTES(COMMIT_MESSAGE);
+    print_params(params, "default options", true, false, false);
+    print_params(params, "changed options", false, true, true);
+}
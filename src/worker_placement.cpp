@@ -0,0 +1,257 @@
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "worker_placement.h"
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+/*!
+ * \brief Parse a kernel CPU list, e.g. "0-3,8-11".
+ *
+ * \param cpulist The CPU list.
+ *
+ * \return The CPU numbers.
+ */
+static vector<int> parse_cpulist(const string& cpulist)
+{
+    vector<int> cpus;
+
+    stringstream cpulist_stream(cpulist);
+    string range;
+    while(getline(cpulist_stream, range, ','))
+    {
+        if(range.empty() || range == "\n")
+            continue;
+
+        int first = 0, last = 0;
+        const size_t dash = range.find('-');
+
+        first = stoi(range.substr(0, dash));
+        last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+
+        for(int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Format CPU numbers as a kernel CPU list.
+ *
+ * \param cpus The sorted CPU numbers.
+ *
+ * \return The CPU list, e.g. "0-3,8-11".
+ */
+static string format_cpulist(const vector<int>& cpus)
+{
+    stringstream cpulist;
+
+    for(size_t i = 0; i < cpus.size(); )
+    {
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+
+        cpulist << (i ? "," : "") << cpus[i];
+        if(j > i)
+            cpulist << "-" << cpus[j];
+
+        i = j + 1;
+    }
+
+    return cpulist.str();
+}
+
+/*!
+ * \brief Read the NUMA nodes from sysfs, restricted to the CPUs the process is allowed to run on.
+ *
+ * \param allowed The allowed CPU set.
+ *
+ * \return Pairs of the node number and its allowed CPUs, a single node 0 with all allowed CPUs if sysfs has no nodes.
+ */
+static vector<pair<int, vector<int>>> read_numa_nodes(const cpu_set_t& allowed)
+{
+    vector<pair<int, vector<int>>> nodes;
+
+    const string node_dir = "/sys/devices/system/node";
+    DIR* dir = opendir(node_dir.c_str());
+    if(dir != nullptr)
+    {
+        while(dirent* entry = readdir(dir))
+        {
+            const string name = entry->d_name;
+            if(name.compare(0, 4, "node") || name.size() == 4 || name.find_first_not_of("0123456789", 4) != string::npos)
+                continue;
+
+            ifstream cpulist_stream(node_dir + "/" + name + "/cpulist");
+            string cpulist;
+            getline(cpulist_stream, cpulist);
+
+            vector<int> cpus;
+            for(int cpu : parse_cpulist(cpulist))
+                if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+
+            if(!cpus.empty())
+                nodes.emplace_back(stoi(name.substr(4)), cpus);
+        }
+
+        closedir(dir);
+    }
+
+    if(nodes.empty())
+    {
+        vector<int> cpus;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if(CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+
+        nodes.emplace_back(0, cpus);
+    }
+
+    sort(nodes.begin(), nodes.end());
+
+    return nodes;
+}
+
+/*!
+ * \brief Plan the placement of the extract workers over the CPUs the process is allowed to run on.
+ *
+ * Mode "cpu" pins each worker to one CPU, taking the CPUs of the NUMA nodes in turn, so the workers
+ * spread over all sockets. Mode "node" pins each worker to all CPUs of one NUMA node, nodes in turn.
+ * Mode "none" leaves the workers to the OS scheduler and returns an empty plan.
+ *
+ * \param mode The pinning mode: none, cpu or node.
+ * \param count_workers The count of extract workers.
+ *
+ * \return The placement of each worker, empty for mode "none".
+ */
+vector<worker_placement> plan_worker_placement(const string& mode, size_t count_workers)
+{
+    if(mode == "none")
+        return {};
+
+    if(mode != "cpu" && mode != "node")
+        throw logic_error("unknown pin_cpus: " + mode + ", expected none, cpu or node");
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed))
+        throw runtime_error(string("sched_getaffinity failed: ") + strerror(errno));
+
+    const vector<pair<int, vector<int>>> nodes = read_numa_nodes(allowed);
+
+    vector<worker_placement> placements;
+
+    if(mode == "node")
+    {
+        for(size_t i = 0; i < count_workers; i++)
+        {
+            const auto& node = nodes[i % nodes.size()];
+            placements.push_back({node.second, node.first, node.second});
+        }
+    }
+    else
+    {
+        // interleave the nodes: node 0 cpu 0, node 1 cpu 0, ..., node 0 cpu 1, ...
+        size_t count_cpus = 0;
+        for(const auto& node : nodes)
+            count_cpus += node.second.size();
+
+        vector<worker_placement> cpu_order;
+        for(size_t k = 0; cpu_order.size() < count_cpus; k++)
+            for(const auto& node : nodes)
+                if(k < node.second.size())
+                    cpu_order.push_back({{node.second[k]}, node.first, node.second});
+
+        if(count_workers > cpu_order.size())
+            LOG(WARNING) << "pin_cpus: " << count_workers << " workers on " << cpu_order.size() << " cpus, some cpus run several workers";
+
+        for(size_t i = 0; i < count_workers; i++)
+            placements.push_back(cpu_order[i % cpu_order.size()]);
+    }
+
+    return placements;
+}
+
+/*!
+ * \brief Set the CPU affinity of the calling thread.
+ *
+ * \param cpus The CPUs.
+ * \param fork_index The index of the extract worker.
+ */
+static void set_thread_cpus(const vector<int>& cpus, size_t fork_index)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for(int cpu : cpus)
+        CPU_SET(cpu, &cpu_set);
+
+    if(sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set))
+        throw runtime_error("proc " + to_string(fork_index) + " - sched_setaffinity failed: " + strerror(errno));
+}
+
+/*!
+ * \brief Apply the placement to the calling thread, pinning it to the CPUs of the NUMA node of the worker.
+ *
+ * \param placement The placement of the worker.
+ * \param bind_memory Flag to indicate whether to bind memory allocations to the NUMA node of the worker.
+ * \param fork_index The index of the extract worker.
+ */
+scoped_worker_placement::scoped_worker_placement(const worker_placement& placement, bool bind_memory, size_t fork_index)
+    : m_placement(placement), m_fork_index(fork_index), m_memory_bound(false)
+{
+    CPU_ZERO(&m_saved_cpus);
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &m_saved_cpus))
+        throw runtime_error(string("sched_getaffinity failed: ") + strerror(errno));
+
+    set_thread_cpus(placement.node_cpus, fork_index);
+
+    if(bind_memory)
+    {
+        const size_t bits = 8 * sizeof(unsigned long);
+        vector<unsigned long> nodemask(static_cast<size_t>(placement.node) / bits + 1, 0);
+        nodemask[static_cast<size_t>(placement.node) / bits] |= 1UL << (static_cast<size_t>(placement.node) % bits);
+
+        if(syscall(SYS_set_mempolicy, MPOL_BIND, nodemask.data(), nodemask.size() * bits + 1))
+            LOG(WARNING) << "proc " << fork_index << " - set_mempolicy failed: " << strerror(errno) << ", memory is not bound";
+        else
+            m_memory_bound = true;
+    }
+
+    LOG(INFO) << "proc " << fork_index << " - placement: cpus " << format_cpulist(placement.cpus) << ", decode threads on cpus "
+              << format_cpulist(placement.node_cpus) << ", node " << placement.node << (m_memory_bound ? ", memory bound to the node" : "");
+}
+
+/*!
+ * \brief Pin the calling thread to the CPUs of the worker, call it once the decode threads are started.
+ */
+void scoped_worker_placement::pin_worker_cpus()
+{
+    set_thread_cpus(m_placement.cpus, m_fork_index);
+}
+
+scoped_worker_placement::~scoped_worker_placement()
+{
+    sched_setaffinity(0, sizeof(cpu_set_t), &m_saved_cpus);
+
+    if(m_memory_bound)
+        syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+}